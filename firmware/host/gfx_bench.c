@@ -0,0 +1,74 @@
+// Microbenchmark for the oled_gfx rectangle primitives, comparing the
+// page-mask fill against the old pixel-at-a-time loops.
+#include <stdio.h>
+#include <time.h>
+
+#include "oled_gfx.h"
+
+#define ITERATIONS 20000
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// what gfx_clear_area/gfx_fill_area did before the page-mask rewrite
+static void pixel_clear_area(int x, int y, int w, int h)
+{
+    for(int y1 = y; y1 < y+h; y1++){
+        for(int x1 = x; x1 < x+w; x1++){
+            gfx_clear_pixel(x1, y1);
+        }
+    }
+}
+
+static void pixel_fill_area(int x, int y, int w, int h)
+{
+    for(int y1 = y; y1 < y+h; y1++){
+        for(int x1 = x; x1 < x+w; x1++){
+            gfx_set_pixel(x1, y1);
+        }
+    }
+}
+
+typedef void (*rect_fn)(int x, int y, int w, int h);
+
+// alternate fill and clear so every call really changes the framebuffer
+static double bench(rect_fn fill, rect_fn clear, int x, int y, int w, int h)
+{
+    double start = now_ns();
+    for(int i = 0; i < ITERATIONS; i++){
+        fill(x, y, w, h);
+        clear(x, y, w, h);
+    }
+    return (now_ns() - start) / (2.0 * ITERATIONS);
+}
+
+static void report(const char *name, int x, int y, int w, int h)
+{
+    double pixel = bench(pixel_fill_area, pixel_clear_area, x, y, w, h);
+    double mask = bench(gfx_fill_area, gfx_clear_area, x, y, w, h);
+    printf("%-22s %4dx%-3d %10.1f %10.1f %8.1fx\n", name, w, h, pixel, mask, pixel / mask);
+}
+
+int main()
+{
+    gfx_init(NULL, NULL);
+
+    printf("%-22s %8s %10s %10s %9s\n", "rectangle", "size", "pixel ns", "mask ns", "speedup");
+    report("graph area", 0, 32, 128, 32);
+    report("full screen", 0, 0, GFX_WIDTH, GFX_HEIGHT);
+    report("unaligned block", 3, 5, 50, 20);
+    report("text line", 0, 10, 64, 8);
+    report("vertical line", 40, 33, 1, 30);
+    report("horizontal line", 0, 45, 128, 1);
+
+    double start = now_ns();
+    for(int i = 0; i < ITERATIONS; i++){
+        gfx_invert_area(0, 32, 128, 32);
+    }
+    printf("%-22s %4dx%-3d %10s %10.1f\n", "xor invert", 128, 32, "-", (now_ns() - start) / ITERATIONS);
+    return 0;
+}
@@ -0,0 +1,23 @@
+// host stand-in for the gpio driver, levels are kept in gpio_stub_levels
+#ifndef GPIO_H
+#define GPIO_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define GPIO_STUB_PINS 32
+
+typedef int gpio_num_t;
+
+typedef enum {
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT,
+} gpio_mode_t;
+
+extern uint32_t gpio_stub_levels;
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode);
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+int gpio_get_level(gpio_num_t gpio_num);
+
+#endif // GPIO_H
@@ -0,0 +1,22 @@
+// host stand-in for the esp-idf error type
+#ifndef ESP_ERR_H
+#define ESP_ERR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK   0
+#define ESP_FAIL -1
+
+#define ESP_ERROR_CHECK(x) do {                                     \
+        esp_err_t err_rc_ = (x);                                    \
+        if (err_rc_ != ESP_OK) {                                    \
+            fprintf(stderr, "%s failed: %d\n", #x, err_rc_);        \
+            abort();                                                \
+        }                                                           \
+    } while (0)
+
+#endif // ESP_ERR_H
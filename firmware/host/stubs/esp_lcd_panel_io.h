@@ -0,0 +1,17 @@
+// host stand-in for esp_lcd, just enough for oled_gfx to compile
+#ifndef ESP_LCD_PANEL_IO_H
+#define ESP_LCD_PANEL_IO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "esp_err.h"
+
+typedef struct esp_lcd_panel_io_t *esp_lcd_panel_io_handle_t;
+typedef struct esp_lcd_panel_t *esp_lcd_panel_handle_t;
+
+esp_err_t esp_lcd_panel_io_tx_param(esp_lcd_panel_io_handle_t io, int lcd_cmd, const void *param, size_t param_size);
+esp_err_t esp_lcd_panel_io_tx_color(esp_lcd_panel_io_handle_t io, int lcd_cmd, const void *color, size_t color_size);
+
+#endif // ESP_LCD_PANEL_IO_H
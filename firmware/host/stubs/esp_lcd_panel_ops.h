@@ -0,0 +1,8 @@
+#ifndef ESP_LCD_PANEL_OPS_H
+#define ESP_LCD_PANEL_OPS_H
+
+#include "esp_lcd_panel_io.h"
+
+esp_err_t esp_lcd_panel_draw_bitmap(esp_lcd_panel_handle_t panel, int x_start, int y_start, int x_end, int y_end, const void *color_data);
+
+#endif // ESP_LCD_PANEL_OPS_H
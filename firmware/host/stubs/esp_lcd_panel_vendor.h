@@ -0,0 +1,6 @@
+#ifndef ESP_LCD_PANEL_VENDOR_H
+#define ESP_LCD_PANEL_VENDOR_H
+
+#include "esp_lcd_panel_io.h"
+
+#endif // ESP_LCD_PANEL_VENDOR_H
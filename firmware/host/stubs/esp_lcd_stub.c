@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_lcd_panel_ops.h"
+#include "esp_lcd_stub.h"
+
+#define PBM_ROW_BYTES (ESP_LCD_STUB_WIDTH / 8)
+
+struct esp_lcd_stub_stats esp_lcd_stub_stats;
+uint8_t esp_lcd_stub_panel[ESP_LCD_STUB_HEIGHT / 8][ESP_LCD_STUB_WIDTH];
+
+// the rectangle is page aligned and packed page by page, like on the ssd1306
+esp_err_t esp_lcd_panel_draw_bitmap(esp_lcd_panel_handle_t panel, int x_start, int y_start, int x_end, int y_end, const void *color_data)
+{
+    const uint8_t *data = color_data;
+    int w = x_end - x_start;
+    for (int page = y_start / 8; page < y_end / 8; page++) {
+        memcpy(&esp_lcd_stub_panel[page][x_start], data, w);
+        data += w;
+    }
+
+    esp_lcd_stub_stats.calls++;
+    esp_lcd_stub_stats.bytes += (x_end - x_start) * (y_end - y_start) / 8;
+    return ESP_OK;
+}
+
+static int ram_page, ram_column;
+
+// sh1106 page and column address commands, the others are just accepted
+esp_err_t esp_lcd_panel_io_tx_param(esp_lcd_panel_io_handle_t io, int lcd_cmd, const void *param, size_t param_size)
+{
+    if (param_size > 0) return ESP_OK;
+    if (lcd_cmd >= 0xB0 && lcd_cmd < 0xB0 + ESP_LCD_STUB_HEIGHT / 8) {
+        ram_page = lcd_cmd & 0x0F;
+    } else if (lcd_cmd < 0x10) {
+        ram_column = (ram_column & 0xF0) | lcd_cmd;
+    } else if (lcd_cmd < 0x20) {
+        ram_column = (ram_column & 0x0F) | (lcd_cmd & 0x0F) << 4;
+    }
+    return ESP_OK;
+}
+
+// data goes to the current page from the column address on, which moves
+// along with it. only the visible columns end up on the panel
+esp_err_t esp_lcd_panel_io_tx_color(esp_lcd_panel_io_handle_t io, int lcd_cmd, const void *color, size_t color_size)
+{
+    const uint8_t *data = color;
+    for (size_t i = 0; i < color_size && ram_column < ESP_LCD_STUB_SH1106_COLUMNS; i++, ram_column++) {
+        int x = ram_column - ESP_LCD_STUB_SH1106_OFFSET;
+        if (x >= 0 && x < ESP_LCD_STUB_WIDTH) esp_lcd_stub_panel[ram_page][x] = data[i];
+    }
+
+    esp_lcd_stub_stats.calls++;
+    esp_lcd_stub_stats.bytes += color_size;
+    return ESP_OK;
+}
+
+int esp_lcd_stub_get_pixel(int x, int y)
+{
+    return (esp_lcd_stub_panel[y / 8][x] >> (y % 8)) & 1;
+}
+
+// raw pbm rows, msb first, a set bit is a lit pixel
+static void pbm_rows(uint8_t rows[ESP_LCD_STUB_HEIGHT][PBM_ROW_BYTES])
+{
+    memset(rows, 0, ESP_LCD_STUB_HEIGHT * PBM_ROW_BYTES);
+    for (int y = 0; y < ESP_LCD_STUB_HEIGHT; y++) {
+        for (int x = 0; x < ESP_LCD_STUB_WIDTH; x++) {
+            if (esp_lcd_stub_get_pixel(x, y)) rows[y][x / 8] |= 0x80 >> (x % 8);
+        }
+    }
+}
+
+int esp_lcd_stub_write_pbm(const char *path)
+{
+    uint8_t rows[ESP_LCD_STUB_HEIGHT][PBM_ROW_BYTES];
+    pbm_rows(rows);
+
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+    fprintf(f, "P4\n%d %d\n", ESP_LCD_STUB_WIDTH, ESP_LCD_STUB_HEIGHT);
+    fwrite(rows, 1, sizeof(rows), f);
+    fclose(f);
+    return 0;
+}
+
+int esp_lcd_stub_diff_pbm(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    int w, h;
+    uint8_t golden[ESP_LCD_STUB_HEIGHT][PBM_ROW_BYTES];
+    int ok = fscanf(f, "P4 %d %d", &w, &h) == 2 && fgetc(f) != EOF &&
+             w == ESP_LCD_STUB_WIDTH && h == ESP_LCD_STUB_HEIGHT &&
+             fread(golden, 1, sizeof(golden), f) == sizeof(golden);
+    fclose(f);
+    if (!ok) return -1;
+
+    uint8_t rows[ESP_LCD_STUB_HEIGHT][PBM_ROW_BYTES];
+    pbm_rows(rows);
+    int diff = 0;
+    for (int y = 0; y < ESP_LCD_STUB_HEIGHT; y++) {
+        for (int i = 0; i < PBM_ROW_BYTES; i++) {
+            diff += __builtin_popcount(rows[y][i] ^ golden[y][i]);
+        }
+    }
+    return diff;
+}
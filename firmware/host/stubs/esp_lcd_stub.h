@@ -0,0 +1,31 @@
+// counters and panel contents kept by the host esp_lcd_panel_draw_bitmap stub
+#ifndef ESP_LCD_STUB_H
+#define ESP_LCD_STUB_H
+
+#include <stdint.h>
+
+// a 1 bpp monochrome panel in the ssd1306 page layout
+#define ESP_LCD_STUB_WIDTH  128
+#define ESP_LCD_STUB_HEIGHT 64
+// the sh1106 path writes through the io into 132 columns of ram, of which
+// the panel shows those from column 2 on
+#define ESP_LCD_STUB_SH1106_COLUMNS 132
+#define ESP_LCD_STUB_SH1106_OFFSET  2
+
+struct esp_lcd_stub_stats
+{
+    uint32_t calls;
+    uint32_t bytes;
+};
+
+extern struct esp_lcd_stub_stats esp_lcd_stub_stats;
+
+// what the panel would show, one byte per column per page
+extern uint8_t esp_lcd_stub_panel[ESP_LCD_STUB_HEIGHT / 8][ESP_LCD_STUB_WIDTH];
+
+int esp_lcd_stub_get_pixel(int x, int y);
+int esp_lcd_stub_write_pbm(const char *path);
+// pixels that differ from a pbm file, -1 when it can't be read
+int esp_lcd_stub_diff_pbm(const char *path);
+
+#endif // ESP_LCD_STUB_H
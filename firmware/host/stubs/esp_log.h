@@ -0,0 +1,16 @@
+// host stand-in for esp_log, warnings and errors always go to stderr,
+// info and debug only when esp_log_stub_verbose is set
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+extern bool esp_log_stub_verbose;
+
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) do { if (esp_log_stub_verbose) fprintf(stderr, "I %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, fmt, ...) do { if (0) fprintf(stderr, "D %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+
+#endif // ESP_LOG_H
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include "esp_timer.h"
+#include "esp_timer_stub.h"
+
+#define ESP_TIMER_STUB_MAX 8
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    int64_t expiry;         // -1 while stopped
+    int64_t period;         // 0 for one-shot timers
+};
+
+static struct esp_timer timers[ESP_TIMER_STUB_MAX];
+static int timer_count = 0;
+static int64_t now_us = 0;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle)
+{
+    if (timer_count == ESP_TIMER_STUB_MAX) return ESP_FAIL;
+    struct esp_timer *timer = &timers[timer_count++];
+    timer->args = *args;
+    timer->expiry = -1;
+    timer->period = 0;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    timer->expiry = now_us + timeout_us;
+    timer->period = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    timer->expiry = now_us + period;
+    timer->period = period;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    timer->expiry = -1;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time()
+{
+    return now_us;
+}
+
+void esp_timer_stub_advance(int64_t us)
+{
+    int64_t until = now_us + us;
+    for (;;) {
+        // fire the earliest due timer, callbacks may restart any timer
+        struct esp_timer *next = NULL;
+        for (int i = 0; i < timer_count; i++) {
+            if (timers[i].expiry >= 0 && timers[i].expiry <= until && (!next || timers[i].expiry < next->expiry)) {
+                next = &timers[i];
+            }
+        }
+        if (!next) break;
+
+        now_us = next->expiry;
+        next->expiry = next->period ? next->expiry + next->period : -1;
+        next->args.callback(next->args.arg);
+    }
+    now_us = until;
+}
+
+void esp_timer_stub_reset()
+{
+    timer_count = 0;
+    now_us = 0;
+}
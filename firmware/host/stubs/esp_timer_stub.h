@@ -0,0 +1,11 @@
+// simulated clock behind the host esp_timer stub
+#ifndef ESP_TIMER_STUB_H
+#define ESP_TIMER_STUB_H
+
+#include <stdint.h>
+
+// move the clock forward, firing every timer that falls due on the way
+void esp_timer_stub_advance(int64_t us);
+void esp_timer_stub_reset();
+
+#endif // ESP_TIMER_STUB_H
@@ -0,0 +1,17 @@
+// host stand-in for the FreeRTOS types used in module headers
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+
+#define portMAX_DELAY 0xFFFFFFFFUL
+
+// nothing runs concurrently on the host
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+#endif // FREERTOS_H
@@ -0,0 +1,11 @@
+// host stand-in for the task notifications of the ui layer, single threaded
+#ifndef TASK_H
+#define TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+#define xTaskNotifyGive(task) ((void)(task))
+
+#endif // TASK_H
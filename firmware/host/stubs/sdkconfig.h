@@ -0,0 +1,37 @@
+// host stand-in for the generated sdkconfig.h, the Kconfig.projbuild defaults
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+#define CONFIG_BEER_FUSION_MEDIAN 1
+#define CONFIG_BEER_FUSION_OUTLIER_DELTA 200
+#define CONFIG_BEER_FUSION_STUCK_SAMPLES 60
+#define CONFIG_BEER_ADAPTIVE_RESOLUTION 1
+#define CONFIG_BEER_PRECISION_BAND 50
+#define CONFIG_BEER_AMBIENT_PROBE -1
+
+#define CONFIG_BEER_CONTROL_PID 1
+#define CONFIG_BEER_PID_KP 1000
+#define CONFIG_BEER_PID_TI 4800
+#define CONFIG_BEER_PID_TD 300
+#define CONFIG_BEER_HEATING_RATE 400
+#define CONFIG_BEER_HEAT_LOSS 130
+#define CONFIG_BEER_AUTOTUNE_HYSTERESIS 20
+#define CONFIG_BEER_AUTOTUNE_CYCLES 3
+#define CONFIG_BEER_HEATER_WINDOW_MS 10000
+#define CONFIG_BEER_HEATER_MIN_SWITCH_MS 1000
+
+// HOST_DISPLAY_SH1106 picks the 1.3" panel instead
+#if HOST_DISPLAY_SH1106
+#define CONFIG_BEER_DISPLAY_SH1106 1
+#define CONFIG_BEER_DISPLAY_COLUMN_OFFSET 2
+#else
+#define CONFIG_BEER_DISPLAY_SSD1306_128X64 1
+#define CONFIG_BEER_DISPLAY_COLUMN_OFFSET 0
+#endif
+#define CONFIG_BEER_DISPLAY_WIDTH 128
+#define CONFIG_BEER_DISPLAY_HEIGHT 64
+
+#define CONFIG_BEER_TELEMETRY_INTERVAL 10
+#define CONFIG_BEER_TELEMETRY_RECOVER_SAMPLES 5760
+
+#endif // SDKCONFIG_H
@@ -0,0 +1,380 @@
+// Closed-loop thermal simulator. The firmware's fusion, control and heater
+// modules drive a first-order model of a fermenter, read back through
+// simulated DS18B20 probes, so controllers can be compared on settling time,
+// overshoot and energy without waiting for real beer to warm up. The "ff" run
+// turns the last probe into an ambient probe and feeds the loss forward.
+// Exits 1 when a prediction of the time to target is off by more than half
+// of the time that was still to go, or when the heater doesn't switch off on
+// the tick its duty drops to 0.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sensor_fusion.h"
+#include "estimator.h"
+#include "control.h"
+#include "feed_forward.h"
+#include "heater.h"
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_timer_stub.h"
+#include "driver/gpio.h"
+
+#define HEATER_PIN          1
+#define SIM_STEP_US         10000
+// the same control period as main.c, the sensor timing comes from temp_sensor.h
+#define CONTROL_PERIOD_US   250000
+#define SIM_PROBES          EXAMPLE_ONEWIRE_MAX_DS18B20
+#define WATER_J_PER_L_K     4186.0
+// within this band of the target the temperature counts as settled
+#define SETTLE_BAND_C       0.25
+// the time to target is predicted this long after the start
+#define ETA_AT_S            600
+
+bool esp_log_stub_verbose = false;
+
+struct sim_config {
+    double hours;
+    double ambient_c;
+    double ambient_drop_c;  // the room cools by this halfway through
+    double start_c;
+    double target_c;
+    double litres;
+    double heater_w;
+    double loss_w_per_k;    // heat lost to ambient per degree of difference
+    double probe_tau_s;     // lag of the probe behind the beer
+    double noise_c;         // gaussian noise on every reading
+    uint32_t seed;
+    bool fixed_resolution;  // always 12 bit, like BEER_ADAPTIVE_RESOLUTION off
+    bool ambient_probe;     // the last probe measures the air
+};
+
+struct sim_result {
+    double settling_s;      // negative when it never settled
+    double overshoot_c;
+    double undershoot_c;    // below the target once it was reached
+    double reached_s;       // first time within the band of the target
+    double eta_s;           // the firmware's prediction of it, ten minutes in
+    double ss_error_c;      // mean absolute error over the last quarter
+    double duty;
+    uint32_t switches;
+    double energy_wh;
+    double end_s;
+    uint32_t conversions;
+};
+
+static uint32_t rng_state;
+
+static double uniform()
+{
+    // xorshift32, deterministic for a given seed on every platform
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (rng_state + 1.0) / 4294967297.0;
+}
+
+static double gaussian()
+{
+    return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+// what the DS18B20 latches at the start of a conversion, in 1/16 C
+static int16_t ds18b20_raw(double temp_c, double noise_c)
+{
+    return (int16_t)lround((temp_c + noise_c * gaussian()) * 16.0);
+}
+
+// a conversion at less than 12 bit drops the low bits
+static int16_t ds18b20_truncate(int16_t raw, uint8_t bits)
+{
+    return raw & ~((1 << (TEMP_SENSOR_BITS_MAX - bits)) - 1);
+}
+
+// the conversion in temp_sensor.c read_scratchpad()
+static int16_t raw_to_centi(int16_t raw, uint8_t bits)
+{
+    if (bits < TEMP_SENSOR_BITS_MAX) {
+        int16_t step = 1 << (TEMP_SENSOR_BITS_MAX - bits);
+        raw = (raw & ~(step - 1)) + step / 2;
+    }
+    return (raw * 25 + (raw < 0 ? -2 : 2)) / 4;
+}
+
+// the same steps as control_task() in main.c
+static void control_step(int16_t temp, int16_t target, int64_t now_us)
+{
+    control_set_feed_forward(feed_forward_update(temp, fusion_get_ambient(), target, now_us));
+    uint16_t duty = control_update(temp, target, now_us);
+    heater_set_duty(duty);
+    estimator_set_duty(duty, now_us);
+}
+
+// run the loop from a cold start, until the time is up or the tuner is done
+static void simulate(const struct sim_config *cfg, bool until_tuned, struct sim_result *res)
+{
+    esp_timer_stub_reset();
+    gpio_stub_levels = 0;
+    rng_state = cfg->seed ? cfg->seed : 1;
+    heater_init(HEATER_PIN);
+    fusion_init();
+    fusion_set_ambient(cfg->ambient_probe ? SIM_PROBES - 1 : -1);
+    feed_forward_reset();
+    estimator_reset();
+    control_reset();
+
+    double capacity = cfg->litres * WATER_J_PER_L_K;
+    double dt = SIM_STEP_US / 1e6;
+    double beer = cfg->start_c;
+    double ambient = cfg->ambient_c;
+    double probes[SIM_PROBES];
+    int16_t raw[SIM_PROBES];
+    for (int i = 0; i < SIM_PROBES; i++) probes[i] = beer;
+    if (cfg->ambient_probe) probes[SIM_PROBES - 1] = ambient;
+    temp_sample_t sample = {.count = SIM_PROBES, .bits = TEMP_SENSOR_BITS_MAX};
+    uint8_t bits = TEMP_SENSOR_BITS_MAX;
+    int64_t conversion_start = 0, conversion_end = -1, last_control = 0;
+    int16_t target = lround(cfg->target_c * 100);
+
+    int64_t end_us = cfg->hours * 3600e6;
+    int64_t tail_us = end_us * 3 / 4;
+    int64_t drop_us = end_us / 2;
+    int64_t eta_at_us = ETA_AT_S * 1000000LL;
+    int64_t on_us = 0, last_outside_us = 0, tail_n = 0;
+    double tail_error = 0;
+    bool reached = cfg->start_c >= cfg->target_c;
+    memset(res, 0, sizeof(*res));
+    res->reached_s = -1;
+    res->eta_s = -1;
+
+    int64_t t;
+    for (t = 0; t < end_us; t += SIM_STEP_US) {
+        if (conversion_end < 0 && t >= conversion_start) {
+            sample.bits = bits;
+            for (int i = 0; i < SIM_PROBES; i++) raw[i] = ds18b20_truncate(ds18b20_raw(probes[i], cfg->noise_c), bits);
+            conversion_end = conversion_start + DS18B20_CONVERSION_US(bits);
+            conversion_start += TEMP_SENSOR_PERIOD_US(bits);
+        } else if (conversion_end >= 0 && t >= conversion_end) {
+            conversion_end = -1;
+            sample.timestamp_us = esp_timer_get_time();
+            sample.seq++;
+            sample.valid_mask = (1 << SIM_PROBES) - 1;
+            for (int i = 0; i < SIM_PROBES; i++) sample.temps[i] = raw_to_centi(raw[i], sample.bits);
+
+            int16_t fused;
+            if (fusion_update(&sample, &fused)) {
+                control_step(estimator_correct(fused, sample.bits, t), target, t);
+                last_control = t;
+                if (!cfg->fixed_resolution) bits = estimator_resolution(target);
+            }
+            res->conversions++;
+            if (until_tuned && control_get_ops() != &controller_autotune) break;
+            if (t >= eta_at_us && res->eta_s < 0 && res->reached_s < 0) {
+                int32_t eta = feed_forward_eta_s(estimator_predict(t), target, true);
+                if (eta >= 0) res->eta_s = t / 1e6 + eta;
+            }
+        } else if (t - last_control >= CONTROL_PERIOD_US) {
+            // the estimate between conversions
+            int16_t predicted = estimator_predict(t);
+            if (predicted != TEMP_INVALID) control_step(predicted, target, t);
+            last_control = t;
+        }
+
+        // first-order plant: heater power in, loss to ambient out
+        esp_timer_stub_advance(SIM_STEP_US);
+        bool on = gpio_get_level(HEATER_PIN);
+        if (t == drop_us) ambient -= cfg->ambient_drop_c;
+        beer += dt * ((on ? cfg->heater_w : 0) - cfg->loss_w_per_k * (beer - ambient)) / capacity;
+        for (int i = 0; i < SIM_PROBES; i++) {
+            double measured = cfg->ambient_probe && i == SIM_PROBES - 1 ? ambient : beer;
+            probes[i] += (measured - probes[i]) * dt / cfg->probe_tau_s;
+        }
+        if (on) on_us += SIM_STEP_US;
+
+        double error = beer - cfg->target_c;
+        if (error >= 0) reached = true;
+        if (reached && error > res->overshoot_c) res->overshoot_c = error;
+        if (reached && -error > res->undershoot_c) res->undershoot_c = -error;
+        if (res->reached_s < 0 && fabs(error) <= SETTLE_BAND_C) res->reached_s = t / 1e6;
+        if (fabs(error) > SETTLE_BAND_C) last_outside_us = t + SIM_STEP_US;
+        if (t >= tail_us) {
+            tail_error += fabs(error);
+            tail_n++;
+        }
+    }
+
+    res->end_s = t / 1e6;
+    res->settling_s = last_outside_us >= t ? -1 : last_outside_us / 1e6;
+    res->ss_error_c = tail_n ? tail_error / tail_n : 0;
+    res->duty = t ? (double)on_us / t : 0;
+    res->switches = heater_switch_count();
+    res->energy_wh = cfg->heater_w * on_us / 3600e6;
+}
+
+// off has to end a running pulse at once and not come back from the on time
+// still owed, that is what a sensor fault or an off command relies on
+static bool heater_off_failed()
+{
+    esp_timer_stub_reset();
+    gpio_stub_levels = 0;
+    heater_init(HEATER_PIN);
+
+    // owe on time to the next windows, then cut it off within a pulse
+    heater_set_duty(HEATER_DUTY_MAX / 2 + HEATER_DUTY_MAX / 20);
+    esp_timer_stub_advance((int64_t)CONFIG_BEER_HEATER_WINDOW_MS * 1000 + SIM_STEP_US);
+    bool was_on = gpio_get_level(HEATER_PIN);
+    heater_set_duty(0);
+    bool failed = !was_on || gpio_get_level(HEATER_PIN) || heater_is_on();
+
+    for (int window = 0; window < 3 && !failed; window++) {
+        esp_timer_stub_advance((int64_t)CONFIG_BEER_HEATER_WINDOW_MS * 1000);
+        failed = gpio_get_level(HEATER_PIN);
+    }
+    return failed;
+}
+
+static bool eta_failed = false;
+
+static void print_result(const char *name, const struct sim_result *res)
+{
+    // a target reached after the prediction was due has to have one, and a close one
+    if (res->reached_s > ETA_AT_S &&
+        (res->eta_s < 0 || fabs(res->eta_s - res->reached_s) > (res->reached_s - ETA_AT_S) / 2)) {
+        eta_failed = true;
+    }
+
+    char settle[16];
+    if (res->settling_s < 0) {
+        strcpy(settle, "-");
+    } else {
+        snprintf(settle, sizeof(settle), "%.2f h", res->settling_s / 3600);
+    }
+    char eta[16] = "-";
+    if (res->eta_s >= 0 && res->reached_s >= 0) {
+        snprintf(eta, sizeof(eta), "%+.0f min", (res->eta_s - res->reached_s) / 60);
+    }
+    printf("%-10s %9s %9.2f C %9.2f C %9.3f C %7.1f%% %9u %9.1f Wh %11u %10s\n", name, settle, res->overshoot_c,
+           res->undershoot_c, res->ss_error_c, res->duty * 100, res->switches, res->energy_wh, res->conversions, eta);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -c list     controllers to run: bang,pid,ff,tune (all)\n"
+            "  -H hours    simulated time per run (24)\n"
+            "  -t temp     target, C (22)\n"
+            "  -s temp     start temperature, C (15)\n"
+            "  -a temp     ambient temperature, C (15)\n"
+            "  -D temp     ambient drop halfway through, C (0)\n"
+            "  -l litres   volume of beer (20)\n"
+            "  -w watts    heater power (100)\n"
+            "  -u W/K      loss to ambient (3)\n"
+            "  -p seconds  probe time constant (60)\n"
+            "  -n temp     sensor noise, C rms (0.03)\n"
+            "  -k kp -i ti -d td   pid gains (Kconfig defaults)\n"
+            "  -r seed     noise seed (1)\n"
+            "  -f          fixed 12 bit sensor resolution\n"
+            "  -v          print the firmware log\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    struct sim_config cfg = {
+        .hours = 24,
+        .ambient_c = 15,
+        .start_c = 15,
+        .target_c = 22,
+        .litres = 20,
+        .heater_w = 100,
+        .loss_w_per_k = 3,
+        .probe_tau_s = 60,
+        .noise_c = 0.03,
+        .seed = 1,
+    };
+    const char *controllers = "bang,pid,ff,tune";
+    pid_gains_t gains = {
+        .kp = CONFIG_BEER_PID_KP,
+        .ti_s = CONFIG_BEER_PID_TI,
+        .td_s = CONFIG_BEER_PID_TD,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:H:t:s:a:D:l:w:u:p:n:k:i:d:r:fvh")) != -1) {
+        switch (opt) {
+        case 'c': controllers = optarg; break;
+        case 'H': cfg.hours = atof(optarg); break;
+        case 't': cfg.target_c = atof(optarg); break;
+        case 's': cfg.start_c = atof(optarg); break;
+        case 'a': cfg.ambient_c = atof(optarg); break;
+        case 'D': cfg.ambient_drop_c = atof(optarg); break;
+        case 'l': cfg.litres = atof(optarg); break;
+        case 'w': cfg.heater_w = atof(optarg); break;
+        case 'u': cfg.loss_w_per_k = atof(optarg); break;
+        case 'p': cfg.probe_tau_s = atof(optarg); break;
+        case 'n': cfg.noise_c = atof(optarg); break;
+        case 'k': gains.kp = atoi(optarg); break;
+        case 'i': gains.ti_s = atoi(optarg); break;
+        case 'd': gains.td_s = atoi(optarg); break;
+        case 'r': cfg.seed = strtoul(optarg, NULL, 0); break;
+        case 'f': cfg.fixed_resolution = true; break;
+        case 'v': esp_log_stub_verbose = true; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+
+    printf("%.0f L, %.0f W, %.1f W/K, %.1f -> %.1f C at %.1f C ambient", cfg.litres, cfg.heater_w,
+           cfg.loss_w_per_k, cfg.start_c, cfg.target_c, cfg.ambient_c);
+    if (cfg.ambient_drop_c) printf(" dropping by %.1f C", cfg.ambient_drop_c);
+    printf(", %.0f h\n\n", cfg.hours);
+    printf("%-10s %9s %11s %11s %11s %8s %9s %12s %11s %10s\n", "controller", "settling", "overshoot", "undershoot",
+           "ss error", "duty", "switches", "energy", "conversions", "eta error");
+
+    if (heater_off_failed()) {
+        printf("heater stays on after its duty dropped to 0\n");
+        return 1;
+    }
+
+    struct sim_result res;
+    control_init();
+    if (strstr(controllers, "bang")) {
+        control_set_ops(&controller_bang_bang);
+        simulate(&cfg, false, &res);
+        print_result("bang-bang", &res);
+    }
+    if (strstr(controllers, "pid")) {
+        pid_set_gains(&gains);
+        control_set_ops(&controller_pid);
+        simulate(&cfg, false, &res);
+        print_result("pid", &res);
+    }
+    if (strstr(controllers, "ff")) {
+        pid_set_gains(&gains);
+        control_set_ops(&controller_pid);
+        cfg.ambient_probe = true;
+        simulate(&cfg, false, &res);
+        cfg.ambient_probe = false;
+        print_result("pid+ff", &res);
+    }
+    if (strstr(controllers, "tune")) {
+        control_start_autotune(NULL);
+        simulate(&cfg, true, &res);
+        pid_gains_t tuned;
+        pid_get_gains(&tuned);
+        double tune_s = res.end_s;
+        control_set_ops(&controller_pid);
+        simulate(&cfg, false, &res);
+        print_result("tuned pid", &res);
+        printf("\nauto-tune took %.2f h: kp %ld ti %ld s td %ld s\n", tune_s / 3600, (long)tuned.kp,
+               (long)tuned.ti_s, (long)tuned.td_s);
+    }
+    if (eta_failed) {
+        printf("\ntime to target predictions off by more than half\n");
+        return 1;
+    }
+    return 0;
+}
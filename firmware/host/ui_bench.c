@@ -0,0 +1,240 @@
+// Benchmark and golden-image check for the rendering path. Times the
+// oled_gfx primitives and the graph, renders the typical UI frames through
+// the esp_lcd stub and compares what the panel would show with the images
+// in golden/. built as ui_bench_sh1106 the frames go out through the sh1106
+// page by page flush instead and have to match the same images.
+//
+//   ui_bench           benchmark and compare, exits 1 on a mismatch
+//   ui_bench -u        rewrite the golden images
+//   ui_bench -o dir    also dump every frame as dir/<frame>.pbm
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "oled_gfx.h"
+#include "temp_graph.h"
+#include "ui.h"
+#include "history.h"
+#include "esp_lcd_stub.h"
+
+#define ITERATIONS  20000
+// two days of one second samples, enough to fill every history tier
+#define HISTORY_S   (2 * 24 * 3600)
+
+bool esp_log_stub_verbose = false;
+
+static bool update_golden = false;
+static const char *dump_dir = NULL;
+static int mismatches = 0;
+static uint32_t now_s = 0;
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// a slow swing around 22 C with a little deterministic ripple
+static int16_t synthetic_temp(uint32_t t)
+{
+    return 2200 + (int16_t)lround(40 * sin(t * 2 * M_PI / 5400)) + (int16_t)((t * 7919) % 7) - 3;
+}
+
+static uint32_t append_sample()
+{
+    uint32_t committed = history_append(synthetic_temp(now_s), now_s);
+    now_s++;
+    return committed;
+}
+
+static void report_ns(const char *name, double ns)
+{
+    printf("%-28s %10.1f ns\n", name, ns);
+}
+
+static void bench_primitives()
+{
+    // one byte per row, 8 wide and 4 page bands tall
+    static const char bitmap[32] = {[0 ... 31] = 0x5A};
+    double start;
+
+    printf("%-28s %13s\n", "primitive", "time");
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        gfx_draw_text(0, 10, i & 1 ? "22.13 C " : "22.14 C ");
+    }
+    report_ns("gfx_draw_text 8 chars", (now_ns() - start) / ITERATIONS);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        gfx_draw_text(3, 13, i & 1 ? "22.13 C " : "22.14 C ");
+    }
+    report_ns("gfx_draw_text unaligned", (now_ns() - start) / ITERATIONS);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        gfx_draw_bitmap(i & 1 ? 0 : 5, 0, 8, 32, bitmap);
+    }
+    report_ns("gfx_draw_bitmap 8x32", (now_ns() - start) / ITERATIONS);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (i & 1) {
+            gfx_clear_area(GRAPH_X, GRAPH_Y, GRAPH_W, GRAPH_H);
+        } else {
+            gfx_fill_area(GRAPH_X, GRAPH_Y, GRAPH_W, GRAPH_H);
+        }
+    }
+    report_ns("gfx_clear_area graph", (now_ns() - start) / ITERATIONS);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        gfx_invert_area(0, 0, GFX_WIDTH, GFX_HEIGHT);
+        gfx_flush();
+    }
+    report_ns("gfx_flush full screen", (now_ns() - start) / ITERATIONS);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        gfx_draw_text(0, 10, i & 1 ? "22.13 C " : "22.14 C ");
+        gfx_flush();
+    }
+    report_ns("gfx_flush text line", (now_ns() - start) / ITERATIONS);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        ui_set_readout(UI_TEMP, 2213);
+        ui_set_text(UI_HEAT, "pid   27%");
+        ui_render();
+    }
+    report_ns("ui_render unchanged", (now_ns() - start) / ITERATIONS);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        ui_set_readout(UI_TEMP, i & 1 ? 2213 : 2214);
+        ui_render();
+    }
+    report_ns("ui_render new reading", (now_ns() - start) / ITERATIONS);
+
+    graph_set_zoom(GRAPH_ZOOM_RAW);
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        graph_update(append_sample());
+    }
+    report_ns("graph_update raw", (now_ns() - start) / ITERATIONS);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS / 100; i++) {
+        graph_set_zoom(i % GRAPH_ZOOM_LEVELS);
+    }
+    report_ns("graph redraw (zoom change)", (now_ns() - start) / (ITERATIONS / 100));
+    graph_set_zoom(GRAPH_ZOOM_RAW);
+}
+
+// flush the frame, then report its cost and compare it with the golden image
+static void check_frame(const char *name)
+{
+    struct esp_lcd_stub_stats before = esp_lcd_stub_stats;
+    gfx_flush();
+    uint32_t calls = esp_lcd_stub_stats.calls - before.calls;
+    uint32_t bytes = esp_lcd_stub_stats.bytes - before.bytes;
+
+    char path[256];
+    if (dump_dir) {
+        snprintf(path, sizeof(path), "%s/%s.pbm", dump_dir, name);
+        esp_lcd_stub_write_pbm(path);
+    }
+
+    snprintf(path, sizeof(path), "%s/%s.pbm", GOLDEN_DIR, name);
+    const char *result;
+    char diff_str[32];
+    if (update_golden) {
+        result = esp_lcd_stub_write_pbm(path) == 0 ? "updated" : "write failed";
+    } else {
+        int diff = esp_lcd_stub_diff_pbm(path);
+        if (diff < 0) {
+            result = "no golden image";
+            mismatches++;
+        } else if (diff > 0) {
+            snprintf(diff_str, sizeof(diff_str), "%d pixels differ", diff);
+            result = diff_str;
+            mismatches++;
+        } else {
+            result = "ok";
+        }
+    }
+    printf("%-20s %9u %9u   %s\n", name, calls, bytes, result);
+}
+
+// the status lines set by display_task
+static void set_status(int16_t temp, const char *heat)
+{
+    ui_set_readout(UI_TEMP, temp);
+    ui_set_text(UI_HEAT, heat);
+}
+
+static void render_frames()
+{
+    printf("%-20s %9s %9s   %s\n", "frame", "transfers", "bytes", "golden");
+
+    // the history restored from the log, the graph only shows it from the first sample
+    while (now_s < HISTORY_S) append_sample();
+    ui_init();
+    check_frame("boot");
+
+    ui_graph_sample(append_sample());
+    set_status(synthetic_temp(now_s - 1), "pid   27%");
+    ui_set_icon(UI_ZB, true);
+    ui_render();
+    check_frame("main");
+
+    // the steady state: one new sample and a new reading per second
+    ui_graph_sample(append_sample());
+    set_status(synthetic_temp(now_s - 1), "pid   28%");
+    ui_render();
+    check_frame("main_next_sample");
+
+    static const char *zoom_frames[GRAPH_ZOOM_LEVELS] = {"zoom_raw", "zoom_1min", "zoom_10min", "zoom_1h"};
+    for (int zoom = 1; zoom <= GRAPH_ZOOM_LEVELS; zoom++) {
+        ui_graph_zoom();
+        ui_render();
+        check_frame(zoom_frames[zoom % GRAPH_ZOOM_LEVELS]);
+    }
+
+    set_status(synthetic_temp(now_s - 1), "tune 100%");
+    ui_render();
+    check_frame("autotune");
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "uo:")) != -1) {
+        switch (opt) {
+        case 'u': update_golden = true; break;
+        case 'o': dump_dir = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-u] [-o dir]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // frames first, they need a blank panel and a fresh history
+    gfx_init(NULL, NULL);
+#if CONFIG_BEER_DISPLAY_SH1106
+    gfx_sh1106_init(NULL);
+#endif
+    render_frames();
+    printf("\n");
+    bench_primitives();
+
+    if (mismatches) {
+        printf("\n%d frame(s) differ from the golden images\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
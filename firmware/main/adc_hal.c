@@ -1,42 +1,156 @@
+#include "adc_hal.h"
+#include "string.h"
 
-
-#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
-#include "hal/adc_types.h"
+#include "esp_timer.h"
+#include "esp_check.h"
 #include "esp_log.h"
 
-adc_oneshot_unit_handle_t adc1_handle;
-adc_cali_handle_t cali_handle;
+// 20 kHz over all channels, then the average of every 4 conversions of a
+// channel is one sample: a bit more resolution and less noise, still well
+// above the harmonics of 50/60 Hz mains
+#define ADC_SAMPLE_HZ       20000
+#define ADC_DECIMATION      4
+#define ADC_FRAME_BYTES     (64 * SOC_ADC_DIGI_RESULT_BYTES)
+#define ADC_READ_TIMEOUT_MS 20
+// half width of the range the calibration curve is linearised over for rms
+#define ADC_SLOPE_SPAN      64
 
-void init_adc(){
-    adc_oneshot_unit_init_cfg_t init_config1 = {
-        .unit_id = ADC_UNIT_1,
-    };
-    adc_oneshot_new_unit(&init_config1, &adc1_handle);
+static const char *TAG = "ADC";
+
+static adc_continuous_handle_t adc_handle = NULL;
+static adc_cali_handle_t cali_handles[ADC_HAL_MAX_CHANNELS];
+static int channel_count = 0;
+static int8_t channel_index[SOC_ADC_MAX_CHANNEL_NUM];  // adc channel to result, -1 when unused
+
+// running sums of one channel, samples are the sum of ADC_DECIMATION raw readings
+typedef struct {
+    uint32_t decimate_sum;
+    uint8_t decimate_n;
+    uint32_t n;
+    int64_t sum;
+    int64_t sum_sq;
+} adc_acc_t;
+
+static uint32_t isqrt64(uint64_t x)
+{
+    uint64_t r = 0, bit = 1ULL << 62;
+    while (bit > x) bit >>= 2;
+    while (bit) {
+        if (x >= r + bit) {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return r;
+}
+
+static int raw_to_mv(int channel, int raw)
+{
+    int mv = 0;
+    if (raw < 0) raw = 0;
+    if (raw > (1 << SOC_ADC_DIGI_MAX_BITWIDTH) - 1) raw = (1 << SOC_ADC_DIGI_MAX_BITWIDTH) - 1;
+    adc_cali_raw_to_voltage(cali_handles[channel], raw, &mv);
+    return mv;
+}
 
-    adc_oneshot_chan_cfg_t channelConfig = {
-        .atten = ADC_ATTEN_DB_12,  // 150mV - 2450mV
-        .bitwidth = ADC_BITWIDTH_12,  // resolution 12 bit
+esp_err_t init_adc(const adc_channel_t *channels, int count)
+{
+    ESP_RETURN_ON_FALSE(count > 0 && count <= ADC_HAL_MAX_CHANNELS, ESP_ERR_INVALID_ARG, TAG, "bad channel count");
+
+    adc_continuous_handle_cfg_t handle_config = {
+        .max_store_buf_size = 4 * ADC_FRAME_BYTES,
+        .conv_frame_size = ADC_FRAME_BYTES,
     };
-    adc_oneshot_config_channel(adc1_handle, ADC_CHANNEL_0, &channelConfig);
+    ESP_RETURN_ON_ERROR(adc_continuous_new_handle(&handle_config, &adc_handle), TAG, "new handle failed");
+
+    adc_digi_pattern_config_t pattern[ADC_HAL_MAX_CHANNELS];
+    memset(channel_index, -1, sizeof(channel_index));
+    for (int i = 0; i < count; i++) {
+        pattern[i] = (adc_digi_pattern_config_t){
+            .atten = ADC_ATTEN_DB_12,   // 0 - 3.3 V
+            .channel = channels[i],
+            .unit = ADC_UNIT_1,
+            .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+        };
+        channel_index[channels[i]] = i;
 
-    adc_cali_curve_fitting_config_t cali_config = {
-        .unit_id = ADC_UNIT_1,
-        .chan = ADC_CHANNEL_0,
-        .atten = ADC_ATTEN_DB_12,
-        .bitwidth = ADC_BITWIDTH_DEFAULT,
+        adc_cali_curve_fitting_config_t cali_config = {
+            .unit_id = ADC_UNIT_1,
+            .chan = channels[i],
+            .atten = ADC_ATTEN_DB_12,
+            .bitwidth = ADC_BITWIDTH_DEFAULT,
+        };
+        ESP_RETURN_ON_ERROR(adc_cali_create_scheme_curve_fitting(&cali_config, &cali_handles[i]), TAG, "calibration failed");
+    }
+    channel_count = count;
+
+    adc_continuous_config_t config = {
+        .pattern_num = count,
+        .adc_pattern = pattern,
+        .sample_freq_hz = ADC_SAMPLE_HZ,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
     };
-    adc_cali_create_scheme_curve_fitting(&cali_config, &cali_handle);
+    ESP_RETURN_ON_ERROR(adc_continuous_config(adc_handle, &config), TAG, "config failed");
+    return ESP_OK;
 }
 
-uint16_t get_adc(){
+// the adc holds a power management lock while it runs, so it only runs
+// for the window and light sleep is possible in between
+esp_err_t adc_hal_sample(uint32_t window_ms, adc_hal_result_t *results)
+{
+    ESP_RETURN_ON_FALSE(adc_handle, ESP_ERR_INVALID_STATE, TAG, "not initialised");
+
+    adc_acc_t acc[ADC_HAL_MAX_CHANNELS];
+    memset(acc, 0, sizeof(acc));
+    uint8_t frame[ADC_FRAME_BYTES];
 
-    int raw;
-    adc_oneshot_read(adc1_handle, ADC_CHANNEL_0, &raw);
+    ESP_RETURN_ON_ERROR(adc_continuous_start(adc_handle), TAG, "start failed");
+    int64_t end = esp_timer_get_time() + (int64_t)window_ms * 1000;
+    while (esp_timer_get_time() < end) {
+        uint32_t len = 0;
+        if (adc_continuous_read(adc_handle, frame, sizeof(frame), &len, ADC_READ_TIMEOUT_MS) != ESP_OK) continue;
 
-    int cali;
-    adc_cali_raw_to_voltage(cali_handle, raw, &cali);
+        for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+            const adc_digi_output_data_t *out = (const adc_digi_output_data_t*)&frame[i];
+            if (out->type2.channel >= SOC_ADC_MAX_CHANNEL_NUM) continue;
+            int index = channel_index[out->type2.channel];
+            if (index < 0) continue;
 
-    return (uint16_t)cali;
-}
\ No newline at end of file
+            adc_acc_t *a = &acc[index];
+            a->decimate_sum += out->type2.data;
+            if (++a->decimate_n < ADC_DECIMATION) continue;
+            a->sum += a->decimate_sum;
+            a->sum_sq += (int64_t)a->decimate_sum * a->decimate_sum;
+            a->n++;
+            a->decimate_sum = 0;
+            a->decimate_n = 0;
+        }
+    }
+    adc_continuous_stop(adc_handle);
+
+    for (int i = 0; i < channel_count; i++) {
+        adc_acc_t *a = &acc[i];
+        results[i] = (adc_hal_result_t){.samples = a->n};
+        if (a->n == 0) continue;
+
+        // mean and standard deviation in raw units times ADC_DECIMATION
+        int64_t mean = a->sum / a->n;
+        int64_t var = a->sum_sq / a->n - mean * mean;
+        uint32_t rms = var > 0 ? isqrt64(var) : 0;
+
+        // the calibration curve is close to linear around the mean, its
+        // slope there converts the rms
+        int mean_raw = mean / ADC_DECIMATION;
+        int slope_mv = raw_to_mv(i, mean_raw + ADC_SLOPE_SPAN) - raw_to_mv(i, mean_raw - ADC_SLOPE_SPAN);
+        results[i].mean_mv = raw_to_mv(i, mean_raw);
+        results[i].rms_mv = (int64_t)rms * slope_mv / (2 * ADC_SLOPE_SPAN * ADC_DECIMATION);
+    }
+    return ESP_OK;
+}
@@ -1,7 +1,23 @@
 #ifndef ADC_HAL
 #define ADC_HAL
 
-void init_adc();
-uint16_t get_adc();
+#include <stdint.h>
+#include "esp_err.h"
+#include "hal/adc_types.h"
 
-#endif // ADC_HAL
\ No newline at end of file
+#define ADC_HAL_MAX_CHANNELS 4
+
+// one channel over a sampling window, in calibrated millivolts at the pin
+typedef struct {
+    uint32_t samples;   // decimated samples in the window
+    int32_t mean_mv;
+    int32_t rms_mv;     // of the ac part, around the mean
+} adc_hal_result_t;
+
+// continuous conversion of ADC1 channels through dma, stopped between windows
+esp_err_t init_adc(const adc_channel_t *channels, int count);
+
+// sample all channels for window_ms, blocks for the whole window
+esp_err_t adc_hal_sample(uint32_t window_ms, adc_hal_result_t *results);
+
+#endif // ADC_HAL
@@ -0,0 +1,115 @@
+#include "control.h"
+#include "heater.h"
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+// relay feedback (astrom-hagglund): switch the heater fully on and off around
+// the target and derive the ultimate gain and period from the oscillation
+#define AUTOTUNE_HYSTERESIS CONFIG_BEER_AUTOTUNE_HYSTERESIS
+#define AUTOTUNE_CYCLES     CONFIG_BEER_AUTOTUNE_CYCLES
+#define AUTOTUNE_TIMEOUT_MS (12 * 3600 * 1000U)
+#define AUTOTUNE_RELAY      (HEATER_DUTY_MAX / 2)
+
+static const char *TAG = "AUTOTUNE";
+
+static control_tuned_cb_t tuned_cb = NULL;
+static bool heating;
+static bool switched_off;       // the relay has switched off at least once
+static bool seen_off;           // a full off phase has been observed
+static int cycles;              // completed cycles, the first one is discarded
+static int16_t peak_hi, peak_lo, cycle_hi;
+static uint32_t elapsed_ms, last_off_ms;
+static int32_t amplitude_sum;   // peak to peak, centi-degrees
+static uint32_t period_sum_ms;
+
+static void autotune_reset()
+{
+    heating = false;
+    switched_off = false;
+    seen_off = false;
+    cycles = 0;
+    peak_hi = INT16_MIN;
+    peak_lo = INT16_MAX;
+    elapsed_ms = 0;
+    last_off_ms = 0;
+    amplitude_sum = 0;
+    period_sum_ms = 0;
+}
+
+// tyreus-luyben rules, less aggressive than ziegler-nichols and with far
+// less overshoot on a slow plant like a fermenter
+static void autotune_finish()
+{
+    int n = cycles - 1;
+    int32_t amplitude = amplitude_sum / (2 * n);
+    uint32_t tu_s = period_sum_ms / n / 1000;
+    if (amplitude <= 0 || tu_s == 0) {
+        ESP_LOGW(TAG, "no usable oscillation, keeping the old gains");
+        control_set_ops(&controller_pid);
+        return;
+    }
+
+    // ku = 4 d / (pi a), per mille per degree with a in centi-degrees
+    int32_t ku = (int64_t)400 * AUTOTUNE_RELAY * 100 / (314 * amplitude);
+    pid_gains_t gains = {
+        .kp = ku * 10 / 22,
+        .ti_s = tu_s * 22 / 10,
+        .td_s = tu_s * 10 / 63,
+    };
+    ESP_LOGI(TAG, "ku %ld, tu %lu s, amplitude %ld", (long)ku, (unsigned long)tu_s, (long)amplitude);
+    pid_set_gains(&gains);
+    control_set_ops(&controller_pid);
+    if (tuned_cb) tuned_cb(&gains);
+}
+
+static uint16_t autotune_update(int16_t temp, int16_t target, uint32_t dt_ms)
+{
+    elapsed_ms += dt_ms;
+    if (elapsed_ms > AUTOTUNE_TIMEOUT_MS) {
+        ESP_LOGW(TAG, "timed out after %d cycles", cycles);
+        control_set_ops(&controller_pid);
+        return 0;
+    }
+    if (temp > peak_hi) peak_hi = temp;
+    if (temp < peak_lo) peak_lo = temp;
+
+    if (heating && temp > target + AUTOTUNE_HYSTERESIS) {
+        // a cycle runs from one switch off to the next
+        if (seen_off) {
+            if (cycles > 0) {
+                amplitude_sum += cycle_hi - peak_lo;
+                period_sum_ms += elapsed_ms - last_off_ms;
+            }
+            cycles++;
+            ESP_LOGI(TAG, "cycle %d: %d .. %d", cycles, peak_lo, cycle_hi);
+            if (cycles > AUTOTUNE_CYCLES) {
+                autotune_finish();
+                return 0;
+            }
+        }
+        heating = false;
+        switched_off = true;
+        last_off_ms = elapsed_ms;
+        peak_hi = temp;
+    } else if (!heating && temp < target - AUTOTUNE_HYSTERESIS) {
+        // the peak after switching off, only counts once we switched off ourselves
+        seen_off = switched_off;
+        cycle_hi = peak_hi;
+        heating = true;
+        peak_lo = temp;
+    }
+    return heating ? HEATER_DUTY_MAX : 0;
+}
+
+const controller_ops_t controller_autotune = {
+    .name = "tune",
+    .reset = autotune_reset,
+    .update = autotune_update,
+};
+
+void control_start_autotune(control_tuned_cb_t done)
+{
+    tuned_cb = done;
+    control_set_ops(&controller_autotune);
+}
@@ -0,0 +1,98 @@
+#include "console.h"
+#include "profile.h"
+#include "power.h"
+#include "zb_report.h"
+#include "string.h"
+#include "stdio.h"
+
+#include "sdkconfig.h"
+#include "esp_console.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "driver/uart.h"
+#include "esp_check.h"
+
+static const char *TAG = "CONSOLE";
+
+static int cmd_prof(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        profile_reset();
+        return 0;
+    }
+
+    printf("%-8s %8s %8s %8s %8s %8s\n", "stage", "count", "min us", "avg us", "p99 us", "max us");
+    for (int stage = 0; stage < PROFILE_STAGES; stage++) {
+        profile_summary_t s;
+        profile_get(stage, &s);
+        printf("%-8s %8lu %8lu %8lu %8lu %8lu\n", profile_stage_name(stage), (unsigned long)s.count,
+               (unsigned long)s.min_us, (unsigned long)s.avg_us, (unsigned long)s.p99_us, (unsigned long)s.max_us);
+    }
+
+    printf("\n%-16s %10s\n", "task", "free stack");
+    for (int i = 0; i < profile_task_count(); i++) {
+        TaskHandle_t task = profile_get_task(i);
+        printf("%-16s %10u\n", pcTaskGetName(task), (unsigned)uxTaskGetStackHighWaterMark(task));
+    }
+
+    // a largest block well below the free total means the heap is fragmented
+    printf("\nheap %lu free, %lu minimum, %u largest block\n", (unsigned long)esp_get_free_heap_size(),
+           (unsigned long)esp_get_minimum_free_heap_size(), (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    return 0;
+}
+
+static int cmd_power(int argc, char **argv)
+{
+    power_stats_t s;
+    power_get_stats(&s);
+    printf("uptime      %8ld s\n", (long)(s.uptime_us / 1000000));
+    printf("light sleep %8ld s in %lu sleeps\n", (long)(s.light_sleep_us / 1000000), (unsigned long)s.light_sleeps);
+    printf("display on  %8ld s\n", (long)(s.display_us[POWER_DISPLAY_ON] / 1000000));
+    printf("display dim %8ld s\n", (long)(s.display_us[POWER_DISPLAY_DIM] / 1000000));
+    printf("display off %8ld s\n", (long)(s.display_us[POWER_DISPLAY_OFF] / 1000000));
+
+    zb_report_stats_t report;
+    zb_report_get_stats(&report);
+    printf("zigbee      %8lu frames sent, %lu updates held back\n", (unsigned long)report.sent, (unsigned long)report.suppressed);
+    return 0;
+}
+
+esp_err_t console_start()
+{
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.prompt = "beer>";
+
+    const esp_console_cmd_t commands[] = {
+        {
+            .command = "prof",
+            .help = "Hot path timing, task stack high-water marks and heap, \"prof reset\" clears the histograms",
+            .hint = "[reset]",
+            .func = cmd_prof,
+        },
+        {
+            .command = "power",
+            .help = "Time spent in every power state",
+            .func = cmd_power,
+        },
+    };
+    for (int i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        ESP_RETURN_ON_ERROR(esp_console_cmd_register(&commands[i]), TAG, "register %s failed", commands[i].command);
+    }
+    ESP_RETURN_ON_ERROR(esp_console_register_help_command(), TAG, "register help failed");
+
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+    esp_console_dev_usb_serial_jtag_config_t hw_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+    ESP_RETURN_ON_ERROR(esp_console_new_repl_usb_serial_jtag(&hw_config, &repl_config, &repl), TAG, "repl failed");
+#else
+    esp_console_dev_uart_config_t hw_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    ESP_RETURN_ON_ERROR(esp_console_new_repl_uart(&hw_config, &repl_config, &repl), TAG, "repl failed");
+#if CONFIG_BEER_POWER_SAVE
+    // typing wakes the chip from light sleep, the first few characters are lost
+    uart_set_wakeup_threshold(CONFIG_ESP_CONSOLE_UART_NUM, 3);
+    esp_sleep_enable_uart_wakeup(CONFIG_ESP_CONSOLE_UART_NUM);
+#endif
+#endif
+    return esp_console_start_repl(repl);
+}
@@ -0,0 +1,9 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "esp_err.h"
+
+// serial console with the diagnostics commands, see "help"
+esp_err_t console_start();
+
+#endif // CONSOLE_H
@@ -0,0 +1,180 @@
+#include "control.h"
+#include "heater.h"
+#include "stdlib.h"
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+// bang-bang hysteresis around the target, in centi-degrees
+#define BANG_BANG_BAND  10
+// the derivative acts on the measurement low-passed at td / PID_D_FILTER
+#define PID_D_FILTER    8
+// with a feed forward the integral only acts this close to the target
+#define PID_FF_INTEGRAL_BAND 25
+// a gap this long between samples starts the controller over
+#define CONTROL_MAX_DT_MS 10000
+
+static const char *TAG = "CONTROL";
+
+static const controller_ops_t *controller = NULL;
+static int64_t last_timestamp_us = -1;
+
+// bang-bang
+
+static bool bang_bang_on = false;
+
+static void bang_bang_reset()
+{
+    bang_bang_on = false;
+}
+
+static uint16_t bang_bang_update(int16_t temp, int16_t target, uint32_t dt_ms)
+{
+    (void)dt_ms;
+    if (temp < target - BANG_BANG_BAND) {
+        bang_bang_on = true;
+    } else if (temp > target + BANG_BANG_BAND) {
+        bang_bang_on = false;
+    }
+    return bang_bang_on ? HEATER_DUTY_MAX : 0;
+}
+
+const controller_ops_t controller_bang_bang = {
+    .name = "bang",
+    .reset = bang_bang_reset,
+    .update = bang_bang_update,
+};
+
+// pid
+
+static pid_gains_t gains = {
+    .kp = CONFIG_BEER_PID_KP,
+    .ti_s = CONFIG_BEER_PID_TI,
+    .td_s = CONFIG_BEER_PID_TD,
+};
+static int64_t integral;        // centi-degree milliseconds
+static int32_t filtered;        // centi-degrees << 8
+static bool primed;
+static uint16_t feed_forward;   // per mille, added to the output
+
+static void pid_reset()
+{
+    integral = 0;
+    primed = false;
+}
+
+static int64_t integral_term(int64_t value)
+{
+    if (gains.ti_s <= 0) return 0;
+    return (int64_t)gains.kp * value / (100LL * gains.ti_s * 1000);
+}
+
+static uint16_t pid_update(int16_t temp, int16_t target, uint32_t dt_ms)
+{
+    int32_t error = target - temp;
+    int32_t measured = (int32_t)temp << 8;
+    if (!primed || dt_ms == 0) {
+        filtered = measured;
+        primed = true;
+    }
+
+    // derivative on the filtered measurement, so a new target does not kick it
+    int32_t prev = filtered;
+    int64_t tf_ms = (int64_t)gains.td_s * 1000 / PID_D_FILTER;
+    filtered += (int64_t)(measured - filtered) * dt_ms / (dt_ms + tf_ms + 1);
+    int64_t d = dt_ms ? -(int64_t)gains.kp * gains.td_s * 1000 * (filtered - prev) / ((int64_t)dt_ms * 100 * 256) : 0;
+
+    int64_t p = (int64_t)gains.kp * error / 100;
+    int64_t step = (int64_t)error * dt_ms;
+
+    // anti-windup: hold the integral while the output is saturated in the
+    // direction the error would push it, and keep the term within what the
+    // feed forward leaves of 0..max. with a feed forward the integral only
+    // corrects its error, what piles up on the way to the target overshoots
+    int64_t out = feed_forward + p + d + integral_term(integral + step);
+    bool integrate = !feed_forward || abs(error) <= PID_FF_INTEGRAL_BAND;
+    if (integrate && (out < HEATER_DUTY_MAX || error < 0) && (out > 0 || error > 0)) {
+        integral += step;
+    }
+    int64_t low = 0;
+    if (gains.kp > 0) {
+        int64_t per_duty = 100LL * gains.ti_s * 1000;
+        int64_t limit = (int64_t)(HEATER_DUTY_MAX - feed_forward) * per_duty / gains.kp;
+        if (integral > limit) integral = limit;
+        low = -(int64_t)feed_forward * per_duty / gains.kp;
+    }
+    if (integral < low) integral = low;
+
+    out = feed_forward + p + d + integral_term(integral);
+    if (out < 0) return 0;
+    if (out > HEATER_DUTY_MAX) return HEATER_DUTY_MAX;
+    return out;
+}
+
+const controller_ops_t controller_pid = {
+    .name = "pid",
+    .reset = pid_reset,
+    .update = pid_update,
+};
+
+void pid_set_gains(const pid_gains_t *new_gains)
+{
+    gains = *new_gains;
+    ESP_LOGI(TAG, "pid gains kp %ld ti %ld s td %ld s", (long)gains.kp, (long)gains.ti_s, (long)gains.td_s);
+}
+
+void pid_get_gains(pid_gains_t *out)
+{
+    *out = gains;
+}
+
+// the duty that holds the target against the loss to ambient, so the
+// integral doesn't have to build it up. only the pid uses it
+void control_set_feed_forward(uint16_t duty)
+{
+    feed_forward = duty > HEATER_DUTY_MAX ? HEATER_DUTY_MAX : duty;
+}
+
+// engine
+
+void control_init()
+{
+#if CONFIG_BEER_CONTROL_BANG_BANG
+    control_set_ops(&controller_bang_bang);
+#else
+    control_set_ops(&controller_pid);
+#endif
+}
+
+void control_set_ops(const controller_ops_t *ops)
+{
+    controller = ops;
+    control_reset();
+    ESP_LOGI(TAG, "using %s controller", controller->name);
+}
+
+const controller_ops_t *control_get_ops()
+{
+    return controller;
+}
+
+void control_reset()
+{
+    last_timestamp_us = -1;
+    controller->reset();
+}
+
+uint16_t control_update(int16_t temp, int16_t target, int64_t timestamp_us)
+{
+    uint32_t dt_ms = 0;
+    if (last_timestamp_us >= 0) {
+        int64_t dt = (timestamp_us - last_timestamp_us) / 1000;
+        if (dt > CONTROL_MAX_DT_MS) {
+            controller->reset();
+        } else if (dt > 0) {
+            dt_ms = dt;
+        }
+    }
+    last_timestamp_us = timestamp_us;
+    return controller->update(temp, target, dt_ms);
+}
@@ -0,0 +1,41 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// pid gains in the standard form: kp in per mille heater duty per degree,
+// integral and derivative time in seconds
+typedef struct {
+    int32_t kp;
+    int32_t ti_s;
+    int32_t td_s;
+} pid_gains_t;
+
+// a controller turns the fused temperature into a heater duty in per mille
+typedef struct {
+    const char *name;
+    void (*reset)(void);
+    uint16_t (*update)(int16_t temp, int16_t target, uint32_t dt_ms);
+} controller_ops_t;
+
+typedef void (*control_tuned_cb_t)(const pid_gains_t *gains);
+
+extern const controller_ops_t controller_bang_bang;
+extern const controller_ops_t controller_pid;
+extern const controller_ops_t controller_autotune;
+
+void control_init();
+void control_set_ops(const controller_ops_t *ops);
+const controller_ops_t *control_get_ops();
+void control_reset();
+uint16_t control_update(int16_t temp, int16_t target, int64_t timestamp_us);
+
+void pid_set_gains(const pid_gains_t *gains);
+void pid_get_gains(pid_gains_t *gains);
+void control_set_feed_forward(uint16_t duty);
+
+// relay feedback tuning, switches to pid with the new gains when it is done
+void control_start_autotune(control_tuned_cb_t done);
+
+#endif // CONTROL_H
@@ -0,0 +1,149 @@
+#include "estimator.h"
+#include "temp_sensor.h"
+#include "heater.h"
+#include "stdlib.h"
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+// centi-degrees per hour the heater adds at full duty
+#define HEATING_RATE        CONFIG_BEER_HEATING_RATE
+#define PRECISION_BAND      CONFIG_BEER_PRECISION_BAND
+// the drift follows changes the heater doesn't explain within about this time
+#define ESTIMATOR_TAU_MS    30000
+// the resolution also looks at where the temperature is heading
+#define ESTIMATOR_LOOKAHEAD_S 300
+// no predictions this long after the last conversion, the sensors are gone
+#define ESTIMATOR_MAX_PREDICT_US ((int64_t)3 * TEMP_SENSOR_PERIOD_MS * 1000)
+// a gap this long between conversions starts the estimate over
+#define ESTIMATOR_MAX_GAP_MS 10000
+#define US_PER_HOUR         3600000000LL
+
+static const char *TAG = "ESTIMATOR";
+
+static bool primed = false;
+static int64_t temp_q8;         // centi-degrees << 8 at anchor_us
+static int64_t drift_q8;        // centi-degrees per hour << 8, all but the heater
+static int64_t anchor_us;
+static uint16_t duty = 0;
+static int64_t duty_since_us;
+static int64_t input_us;        // per mille heater duty times us since anchor_us
+static uint8_t resolution = TEMP_SENSOR_BITS_MAX;
+
+void estimator_reset()
+{
+    primed = false;
+    drift_q8 = 0;
+    resolution = TEMP_SENSOR_BITS_MAX;
+}
+
+void estimator_set_duty(uint16_t new_duty, int64_t now_us)
+{
+    if (primed) {
+        input_us += (int64_t)duty * (now_us - duty_since_us);
+    }
+    duty = new_duty;
+    duty_since_us = now_us;
+}
+
+static int64_t predict_q8(int64_t now_us)
+{
+    int64_t input = input_us + (int64_t)duty * (now_us - duty_since_us);
+    return temp_q8 + drift_q8 * (now_us - anchor_us) / US_PER_HOUR +
+           ((int64_t)HEATING_RATE << 8) * input / (HEATER_DUTY_MAX * US_PER_HOUR);
+}
+
+static int16_t q8_to_centi(int64_t value)
+{
+    return value >= 0 ? (value + 128) >> 8 : -((-value + 128) >> 8);
+}
+
+static void anchor(int64_t now_us)
+{
+    anchor_us = now_us;
+    duty_since_us = now_us;
+    input_us = 0;
+}
+
+// predict, then move the temperature and its drift towards the conversion.
+// the gains scale with the time since the last one, so every resolution
+// averages over about the same time and a coarse reading weighs less
+int16_t estimator_correct(int16_t measured, uint8_t bits, int64_t timestamp_us)
+{
+    int64_t dt_ms = (timestamp_us - anchor_us) / 1000;
+    if (!primed || dt_ms <= 0 || dt_ms > ESTIMATOR_MAX_GAP_MS) {
+        temp_q8 = (int64_t)measured << 8;
+        drift_q8 = 0;
+        anchor(timestamp_us);
+        primed = true;
+        return measured;
+    }
+
+    int64_t predicted = predict_q8(timestamp_us);
+    int64_t residual = ((int64_t)measured << 8) - predicted;
+
+    // alpha in 1/65536 and beta in 1/2^32, beta from alpha as for a
+    // critically damped tracker
+    int64_t alpha = 2 * dt_ms * 65536 / ESTIMATOR_TAU_MS;
+    if (alpha > 32768) alpha = 32768;
+    int64_t beta = (alpha * alpha << 16) / (131072 - alpha);
+    // every bit less quadruples the quantisation noise, the drift listens
+    // that much less to it or it chases the steps of a coarse reading
+    beta >>= 2 * (TEMP_SENSOR_BITS_MAX - bits);
+
+    temp_q8 = predicted + residual * alpha / 65536;
+    drift_q8 += residual * (beta * (US_PER_HOUR / 1000) / dt_ms) >> 32;
+    anchor(timestamp_us);
+
+    ESP_LOGD(TAG, "%d -> %d, drift %ld c/h", measured, q8_to_centi(temp_q8), (long)(drift_q8 >> 8));
+    return q8_to_centi(temp_q8);
+}
+
+int16_t estimator_predict(int64_t now_us)
+{
+    if (!primed || now_us - anchor_us > ESTIMATOR_MAX_PREDICT_US) return TEMP_INVALID;
+    return q8_to_centi(predict_q8(now_us));
+}
+
+// centi-degrees per hour, with the heater's share at its current duty
+int32_t estimator_rate()
+{
+    return (drift_q8 >> 8) + (int32_t)HEATING_RATE * duty / HEATER_DUTY_MAX;
+}
+
+// centi-degrees per hour without the heater, the loss to ambient and whatever
+// the heating rate doesn't explain
+int32_t estimator_drift()
+{
+    return drift_q8 >> 8;
+}
+
+// every doubling of the distance past the band costs a bit of resolution
+static uint8_t bits_for(int32_t distance)
+{
+    uint8_t bits = TEMP_SENSOR_BITS_MAX;
+    for (int32_t band = PRECISION_BAND; distance >= band && bits > TEMP_SENSOR_BITS_MIN; band *= 2) {
+        bits--;
+    }
+    return bits;
+}
+
+uint8_t estimator_resolution(int16_t target)
+{
+    if (!primed) return TEMP_SENSOR_BITS_MAX;
+
+    int32_t error = abs(target - q8_to_centi(temp_q8));
+    int32_t ahead = abs(estimator_rate()) * ESTIMATOR_LOOKAHEAD_S / 3600;
+    int32_t distance = error > ahead ? error : ahead;
+
+    // coarser straight away, finer only once well inside the next band,
+    // so it doesn't flip with every conversion at the edge
+    uint8_t coarse = bits_for(distance);
+    uint8_t fine = bits_for(distance + distance / 4);
+    uint8_t bits = coarse < resolution ? coarse : (fine > resolution ? fine : resolution);
+    if (bits != resolution) {
+        ESP_LOGI(TAG, "%d bit resolution, %ld from the target, %ld c/h", bits, (long)error, (long)estimator_rate());
+        resolution = bits;
+    }
+    return resolution;
+}
@@ -0,0 +1,19 @@
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// alpha-beta tracker of the fused temperature and its drift, with the heater
+// duty as a known input, so it can predict the temperature between conversions
+void estimator_reset();
+void estimator_set_duty(uint16_t duty, int64_t now_us);
+int16_t estimator_correct(int16_t measured, uint8_t bits, int64_t timestamp_us);
+int16_t estimator_predict(int64_t now_us);
+int32_t estimator_rate();
+int32_t estimator_drift();
+
+// sensor resolution for the distance to the target and the rate of change
+uint8_t estimator_resolution(int16_t target);
+
+#endif // ESTIMATOR_H
@@ -0,0 +1,103 @@
+#include "feed_forward.h"
+#include "estimator.h"
+#include "temp_sensor.h"
+#include "heater.h"
+#include "stdlib.h"
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+// centi-degrees per hour the heater adds at full duty
+#define HEATING_RATE        CONFIG_BEER_HEATING_RATE
+// per mille of the difference to ambient lost per hour, until it is learnt
+#define HEAT_LOSS           CONFIG_BEER_HEAT_LOSS
+#define HEAT_LOSS_MAX       1000
+// the loss follows the measured drift within about this time
+#define LOSS_TAU_MS         (2 * 3600 * 1000LL)
+// the drift needs a while after a start to settle, and a clear difference
+// to ambient to say anything about the loss
+#define LOSS_SETTLE_US      (600 * 1000000LL)
+#define LOSS_MIN_DIFF       300
+// only learnt close to the target, where the duty is about the feed forward
+// and an error in the heating rate cancels out of it
+#define LOSS_BAND           100
+// a gap this long between updates isn't learnt from
+#define LOSS_MAX_GAP_MS     10000
+// within this of the target it counts as reached
+#define ETA_BAND            25
+#define ETA_MAX_S           (100 * 3600 - 1)
+
+static const char *TAG = "FEED_FORWARD";
+
+static int16_t ambient = TEMP_INVALID;
+static int64_t loss_q8 = (int64_t)HEAT_LOSS << 8;
+static int64_t learn_from_us;
+static int64_t last_us = -1;
+
+void feed_forward_reset()
+{
+    ambient = TEMP_INVALID;
+    loss_q8 = (int64_t)HEAT_LOSS << 8;
+    last_us = -1;
+}
+
+// whatever the estimator can't put down to the heater is taken as the loss
+// to ambient
+static void learn(int16_t temp, int16_t target, int64_t now_us)
+{
+    int32_t diff = temp - ambient;
+    int64_t dt_ms = last_us >= 0 ? (now_us - last_us) / 1000 : 0;
+    if (now_us < learn_from_us || abs(diff) < LOSS_MIN_DIFF || abs(target - temp) > LOSS_BAND ||
+        dt_ms <= 0 || dt_ms > LOSS_MAX_GAP_MS) return;
+
+    int64_t measured = -((int64_t)estimator_drift() << 8) * 1000 / diff;
+    if (measured < 0) measured = 0;
+    if (measured > (int64_t)HEAT_LOSS_MAX << 8) measured = (int64_t)HEAT_LOSS_MAX << 8;
+    loss_q8 += (measured - loss_q8) * dt_ms / LOSS_TAU_MS;
+}
+
+// call with every control step, returns the duty that holds the target
+// against the loss. 0 without an ambient reading or with the room warmer
+uint16_t feed_forward_update(int16_t temp, int16_t new_ambient, int16_t target, int64_t now_us)
+{
+    if (new_ambient == TEMP_INVALID || temp == TEMP_INVALID) {
+        if (ambient != TEMP_INVALID) ESP_LOGW(TAG, "no ambient temperature");
+        ambient = TEMP_INVALID;
+        last_us = -1;
+        return 0;
+    }
+    if (ambient == TEMP_INVALID) {
+        learn_from_us = now_us + LOSS_SETTLE_US;
+        ESP_LOGI(TAG, "ambient %d, loss %ld per mille/h", new_ambient, (long)(loss_q8 >> 8));
+    }
+    ambient = new_ambient;
+    learn(temp, target, now_us);
+    last_us = now_us;
+
+    if (target <= ambient || HEATING_RATE <= 0) return 0;
+    int32_t duty = (loss_q8 >> 8) * (target - ambient) / HEATING_RATE;
+    return duty > HEATER_DUTY_MAX ? HEATER_DUTY_MAX : duty;
+}
+
+// seconds until the target is reached, 0 once it is. full power below the
+// target and none above, against the loss halfway there, or without an
+// ambient probe the loss the estimator measures now
+int32_t feed_forward_eta_s(int16_t temp, int16_t target, bool heating)
+{
+    if (temp == TEMP_INVALID) return FEED_FORWARD_ETA_UNKNOWN;
+    int32_t distance = target - temp;
+    if (abs(distance) <= ETA_BAND) return 0;
+
+    int32_t loss = ambient != TEMP_INVALID ? (loss_q8 >> 8) * ((temp + target) / 2 - ambient) / 1000 : -estimator_drift();
+    int32_t rate = (distance > 0 && heating ? HEATING_RATE : 0) - loss;
+    if (rate == 0 || (rate > 0) != (distance > 0)) return FEED_FORWARD_ETA_UNKNOWN;
+
+    int64_t eta = (int64_t)distance * 3600 / rate;
+    return eta > ETA_MAX_S ? FEED_FORWARD_ETA_UNKNOWN : eta;
+}
+
+// per mille of the difference to ambient per hour
+uint16_t feed_forward_loss()
+{
+    return loss_q8 >> 8;
+}
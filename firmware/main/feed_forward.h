@@ -0,0 +1,17 @@
+#ifndef FEED_FORWARD_H
+#define FEED_FORWARD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FEED_FORWARD_ETA_UNKNOWN    -1
+
+// heat loss to the air, learnt from the estimator's drift against the ambient
+// probe. it becomes a heater bias for the pid, so a colder room is countered
+// before the beer cools, and a prediction of when the target is reached
+void feed_forward_reset();
+uint16_t feed_forward_update(int16_t temp, int16_t ambient, int16_t target, int64_t now_us);
+int32_t feed_forward_eta_s(int16_t temp, int16_t target, bool heating);
+uint16_t feed_forward_loss();
+
+#endif // FEED_FORWARD_H
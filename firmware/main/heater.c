@@ -0,0 +1,141 @@
+#include "heater.h"
+
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+// slow time-proportioned pwm, the ssr switches at most twice a window. a
+// mechanical relay needs a window of minutes
+#define HEATER_WINDOW_MS     CONFIG_BEER_HEATER_WINDOW_MS
+#define HEATER_MIN_SWITCH_MS CONFIG_BEER_HEATER_MIN_SWITCH_MS
+
+// an on and an off period of the minimum have to fit in one window
+_Static_assert(HEATER_MIN_SWITCH_MS * 2 <= HEATER_WINDOW_MS, "BEER_HEATER_MIN_SWITCH_MS is more than half the window");
+
+static const char *TAG = "HEATER";
+
+static gpio_num_t heater_gpio;
+static esp_timer_handle_t window_timer = NULL;
+static esp_timer_handle_t off_timer = NULL;
+static volatile uint16_t duty = 0;
+static volatile bool heater_on = false;
+static volatile uint32_t switches = 0;
+static volatile uint32_t on_total_ms = 0;   // completed on periods
+static volatile uint32_t on_since_ms = 0;
+static int32_t carry_ms = 0;    // on time owed to or by the next windows
+// the timers and heater_set_duty both switch the output
+static portMUX_TYPE output_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void set_output(bool on)
+{
+    portENTER_CRITICAL(&output_lock);
+    if (on == heater_on) {
+        portEXIT_CRITICAL(&output_lock);
+        return;
+    }
+    gpio_set_level(heater_gpio, on);
+    uint32_t now_ms = esp_timer_get_time() / 1000;
+    if (on) {
+        on_since_ms = now_ms;
+    } else {
+        on_total_ms += now_ms - on_since_ms;
+    }
+    heater_on = on;
+    switches++;
+    portEXIT_CRITICAL(&output_lock);
+}
+
+static void off_timer_cb(void *arg)
+{
+    (void)arg;
+    set_output(false);
+}
+
+// pulses shorter than the minimum switch time are dropped or stretched to a
+// full window, the difference is carried over so the average duty still holds
+static void window_timer_cb(void *arg)
+{
+    (void)arg;
+    int32_t wanted = (int32_t)duty * HEATER_WINDOW_MS / HEATER_DUTY_MAX + carry_ms;
+    int32_t on_ms = wanted;
+    if (on_ms < HEATER_MIN_SWITCH_MS) {
+        on_ms = wanted < HEATER_MIN_SWITCH_MS / 2 ? 0 : HEATER_MIN_SWITCH_MS;
+    }
+    if (on_ms > HEATER_WINDOW_MS - HEATER_MIN_SWITCH_MS) {
+        on_ms = wanted > HEATER_WINDOW_MS - HEATER_MIN_SWITCH_MS / 2 ? HEATER_WINDOW_MS : HEATER_WINDOW_MS - HEATER_MIN_SWITCH_MS;
+    }
+    carry_ms = wanted - on_ms;
+    if (carry_ms > HEATER_WINDOW_MS) carry_ms = HEATER_WINDOW_MS;
+    if (carry_ms < -HEATER_WINDOW_MS) carry_ms = -HEATER_WINDOW_MS;
+
+    set_output(on_ms > 0);
+    if (on_ms > 0 && on_ms < HEATER_WINDOW_MS) {
+        esp_timer_start_once(off_timer, (uint64_t)on_ms * 1000);
+    }
+}
+
+void heater_init(gpio_num_t gpio)
+{
+    heater_gpio = gpio;
+    gpio_set_direction(heater_gpio, GPIO_MODE_OUTPUT);
+    gpio_set_level(heater_gpio, 0);
+    heater_on = false;
+    duty = 0;
+    carry_ms = 0;
+    switches = 0;
+    on_total_ms = 0;
+
+    const esp_timer_create_args_t window_args = {
+        .callback = window_timer_cb,
+        .name = "heater_window",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&window_args, &window_timer));
+    const esp_timer_create_args_t off_args = {
+        .callback = off_timer_cb,
+        .name = "heater_off",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&off_args, &off_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(window_timer, (uint64_t)HEATER_WINDOW_MS * 1000));
+    ESP_LOGI(TAG, "%d ms window, %d ms minimum switch time", HEATER_WINDOW_MS, HEATER_MIN_SWITCH_MS);
+}
+
+// takes effect at the start of the next window, except off: that ends the
+// pulse running now and drops the on time still owed
+void heater_set_duty(uint16_t value)
+{
+    duty = value > HEATER_DUTY_MAX ? HEATER_DUTY_MAX : value;
+    if (duty == 0) {
+        if (off_timer) esp_timer_stop(off_timer);
+        carry_ms = 0;
+        set_output(false);
+    }
+}
+
+uint16_t heater_get_duty()
+{
+    return duty;
+}
+
+bool heater_is_on()
+{
+    return heater_on;
+}
+
+uint32_t heater_switch_count()
+{
+    return switches;
+}
+
+// total time the output was on, wraps after 49 days, only use differences
+uint32_t heater_on_time_ms()
+{
+    // the timer callbacks switch the output, retry when one got in between
+    uint32_t count, total;
+    do {
+        count = switches;
+        total = on_total_ms;
+        if (heater_on) total += (uint32_t)(esp_timer_get_time() / 1000) - on_since_ms;
+    } while (count != switches);
+    return total;
+}
@@ -0,0 +1,18 @@
+#ifndef HEATER_H
+#define HEATER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/gpio.h"
+
+// duty is given in per mille of every pwm window
+#define HEATER_DUTY_MAX 1000
+
+void heater_init(gpio_num_t gpio);
+void heater_set_duty(uint16_t duty);
+uint16_t heater_get_duty();
+bool heater_is_on();
+uint32_t heater_switch_count();
+uint32_t heater_on_time_ms();
+
+#endif // HEATER_H
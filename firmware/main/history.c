@@ -0,0 +1,140 @@
+#include "history.h"
+
+// min and max are stored as distance from the average in steps of 0.05 C,
+// which saturates at 12.75 C and packs a bucket into 4 bytes
+#define HISTORY_SPREAD_UNIT 5
+// average of a bucket that received no samples, same as TEMP_INVALID
+#define HISTORY_EMPTY       INT16_MIN
+
+typedef struct {
+    int16_t avg;
+    uint8_t lo;
+    uint8_t hi;
+} history_bucket_t;
+
+typedef struct {
+    uint32_t duration_s;
+    uint16_t len;           // ring capacity in buckets
+    uint16_t offset;        // first bucket of this tier in buckets[]
+} history_tier_cfg_t;
+
+// running aggregate of the bucket that is still filling
+typedef struct {
+    uint32_t index;         // now_s / duration_s of the open bucket
+    int32_t sum;
+    uint16_t count;
+    int16_t min;
+    int16_t max;
+} history_acc_t;
+
+// 16 min at 1 min, 2 h 40 at 10 min and 16 h at 1 h resolution. with the
+// raw window, the counters and the accumulators that is 512 bytes, no more
+// than the graph's float temps[128] this replaced
+static const history_tier_cfg_t tiers[HISTORY_TIERS] = {
+    [HISTORY_1MIN]  = {.duration_s = 60,   .len = 16, .offset = 0},
+    [HISTORY_10MIN] = {.duration_s = 600,  .len = 16, .offset = 16},
+    [HISTORY_1H]    = {.duration_s = 3600, .len = 16, .offset = 32},
+};
+#define HISTORY_BUCKETS 48
+
+static int16_t raw[HISTORY_RAW_LEN];
+static uint32_t raw_count = 0;
+
+static history_bucket_t buckets[HISTORY_BUCKETS];
+static uint32_t bucket_count[HISTORY_TIERS];     // buckets committed per tier
+static history_acc_t acc[HISTORY_TIERS];
+
+static uint8_t pack_spread(int32_t delta)
+{
+    delta = (delta + HISTORY_SPREAD_UNIT - 1) / HISTORY_SPREAD_UNIT;
+    return delta > UINT8_MAX ? UINT8_MAX : delta;
+}
+
+static void commit(history_tier_t tier, const history_acc_t *a)
+{
+    const history_tier_cfg_t *cfg = &tiers[tier];
+    history_bucket_t *b = &buckets[cfg->offset + bucket_count[tier] % cfg->len];
+
+    if (a->count == 0) {
+        b->avg = HISTORY_EMPTY;
+        b->lo = b->hi = 0;
+    } else {
+        b->avg = a->sum / a->count;
+        b->lo = pack_spread(b->avg - a->min);
+        b->hi = pack_spread(a->max - b->avg);
+    }
+    bucket_count[tier]++;
+}
+
+// returns a bitmask of the tiers that completed a bucket with this sample
+uint32_t history_append(int16_t temp, uint32_t now_s)
+{
+    uint32_t committed = 0;
+
+    raw[raw_count++ % HISTORY_RAW_LEN] = temp;
+
+    for (int t = 0; t < HISTORY_TIERS; t++) {
+        history_acc_t *a = &acc[t];
+        uint32_t index = now_s / tiers[t].duration_s;
+
+        if (a->count && index != a->index) {
+            commit(t, a);
+            // a gap without samples leaves empty buckets, at most a full ring
+            uint32_t gap = index - a->index - 1;
+            history_acc_t empty = {0};
+            for (uint32_t i = 0; i < gap && i < tiers[t].len; i++) {
+                commit(t, &empty);
+            }
+            a->count = 0;
+            committed |= 1 << t;
+        }
+        if (a->count == 0) {
+            a->index = index;
+            a->sum = 0;
+            a->min = INT16_MAX;
+            a->max = INT16_MIN;
+        }
+        a->sum += temp;
+        a->count++;
+        if (temp < a->min) a->min = temp;
+        if (temp > a->max) a->max = temp;
+    }
+    return committed;
+}
+
+uint32_t history_raw_count()
+{
+    return raw_count;
+}
+
+// n counts from the first sample ever appended, only the last
+// HISTORY_RAW_LEN are still available
+int16_t history_raw_at(uint32_t n)
+{
+    return raw[n % HISTORY_RAW_LEN];
+}
+
+int history_bucket_count(history_tier_t tier)
+{
+    return bucket_count[tier] < tiers[tier].len ? bucket_count[tier] : tiers[tier].len;
+}
+
+int history_bucket_capacity(history_tier_t tier)
+{
+    return tiers[tier].len;
+}
+
+// age 0 is the most recently completed bucket
+bool history_get_bucket(history_tier_t tier, int age, int16_t *min, int16_t *avg, int16_t *max)
+{
+    if (age < 0 || age >= history_bucket_count(tier)) return false;
+
+    const history_tier_cfg_t *cfg = &tiers[tier];
+    const history_bucket_t *b = &buckets[cfg->offset + (bucket_count[tier] - 1 - age) % cfg->len];
+    if (b->avg == HISTORY_EMPTY) return false;
+
+    *avg = b->avg;
+    *min = b->avg - b->lo * HISTORY_SPREAD_UNIT;
+    *max = b->avg + b->hi * HISTORY_SPREAD_UNIT;
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// the raw tier doubles as the graph's sample window
+#define HISTORY_RAW_LEN 128
+
+// downsampled tiers, each bucket keeps min/avg/max of every raw sample in it
+typedef enum {
+    HISTORY_1MIN,
+    HISTORY_10MIN,
+    HISTORY_1H,
+    HISTORY_TIERS,
+} history_tier_t;
+
+uint32_t history_append(int16_t temp, uint32_t now_s);
+uint32_t history_raw_count();
+int16_t history_raw_at(uint32_t n);
+int history_bucket_count(history_tier_t tier);
+int history_bucket_capacity(history_tier_t tier);
+bool history_get_bucket(history_tier_t tier, int age, int16_t *min, int16_t *avg, int16_t *max);
+
+#endif // HISTORY_H
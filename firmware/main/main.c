@@ -3,11 +3,16 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_bit_defs.h"
 #include "ha/esp_zigbee_ha_standard.h"
 #include "main.h"
 #include "string.h"
+#include "stdio.h"
 #include "driver/gpio.h"
 #include "temp_sensor.h"
+#include "sensor_fusion.h"
+#include "estimator.h"
 
 #include "driver/i2c_master.h"
 #include "esp_lcd_panel_io.h"
@@ -15,18 +20,90 @@
 #include "esp_lcd_panel_ops.h"
 
 #include "oled_gfx.h"
+#include "ui.h"
+#include "history.h"
+#include "telemetry.h"
+#include "heater.h"
+#include "control.h"
+#include "feed_forward.h"
+#include "nvs.h"
+#include "zb_report.h"
+#include "spsc_ring.h"
+#include "power.h"
+#include "profile.h"
+#include "zb_diag.h"
+#include "zb_history.h"
+#if CONFIG_BEER_METER
+#include "meter.h"
+#include "zb_meter.h"
+#endif
+#include "console.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
 
 #define HEATER_PIN GPIO_NUM_1
+#define ZOOM_BUTTON_PIN GPIO_NUM_9 // boot button, cycles the graph zoom level
+#define LONG_PRESS_US (2000 * 1000) // holding it starts the pid auto-tune
+
+// pipeline stages, control outranks everything that talks to the radio or display
+#define CONTROL_TASK_PRIORITY 6
+#define ZIGBEE_TASK_PRIORITY  5
+#define REPORT_TASK_PRIORITY  4
+#define DISPLAY_TASK_PRIORITY 3
+#define FLUSH_TASK_PRIORITY   2
+// stack sizes in bytes, the "prof" console command shows what is left of them
+#define CONTROL_TASK_STACK    3072
+#define ZIGBEE_TASK_STACK     4096
+#define REPORT_TASK_STACK     3072
+#define DISPLAY_TASK_STACK    4096
+#define STAGE_RING_LEN        8
+// between conversions the controller runs on the estimate this often
+#define CONTROL_PERIOD_MS     250
+// the stages downstream of control keep the full resolution sample rate
+#define PUBLISH_PERIOD_US     ((int64_t)TEMP_SENSOR_PERIOD_MS * 1000)
+
+// state shared between tasks and the zigbee callbacks
+#define EVT_ZB_CONNECTED      BIT0
+#define EVT_HEATER_ENABLED    BIT1  // the on/off cluster
+#define EVT_ZOOM_PRESSED      BIT2
+#define EVT_AUTOTUNE_PRESSED  BIT3
 
 static const char *TAG = "MAIN";
-bool zb_connected = false;
-bool switch_state = true;
 
-const float target_temp = 22.0;
-const float temp_offset = 0.1;
-
-float temps[128] = {-1.0f};
-int temp_index = 0;
+// centi-degrees, like every temperature in the firmware
+const int16_t target_temp = 2200;
+
+// what the control stage hands to the display and reporting stages
+typedef struct {
+    int64_t timestamp_us;
+    int16_t temp;
+    uint16_t duty;
+    const char *controller;
+    int16_t ambient;
+    int32_t eta_s;
+    int16_t probe_temps[EXAMPLE_ONEWIRE_MAX_DS18B20];
+} control_state_t;
+
+static EventGroupHandle_t app_events = NULL;
+static StaticEventGroup_t app_events_buf;
+static TaskHandle_t volatile display_task_handle = NULL;   // set once the display is up
+static TaskHandle_t report_task_handle = NULL;
+static control_state_t display_items[STAGE_RING_LEN];
+static control_state_t report_items[STAGE_RING_LEN];
+static spsc_ring_t display_ring;
+static spsc_ring_t report_ring;
+
+// every task and its stack is allocated statically, so the ram they take
+// shows up in the link map and the heap is left to the zigbee stack
+static StaticTask_t control_task_buf, zigbee_task_buf, report_task_buf, display_task_buf;
+static StackType_t control_task_stack[CONTROL_TASK_STACK];
+static StackType_t zigbee_task_stack[ZIGBEE_TASK_STACK];
+static StackType_t report_task_stack[REPORT_TASK_STACK];
+static StackType_t display_task_stack[DISPLAY_TASK_STACK];
+
+// history time keeps running across reboots, continuing from the replayed log
+static uint32_t history_time_offset = 0;
 
 #define DEFINE_PSTRING(var, str)   \
     const struct                   \
@@ -36,98 +113,245 @@ int temp_index = 0;
     }(var) = {sizeof(str) - 1, (str)}
 
 
-void report_output_binary_sensor(uint16_t value)
+static void IRAM_ATTR zoom_button_isr(void *arg)
 {
-    esp_zb_zcl_set_attribute_val(
-        HA_ESP_ENDPOINT,
-        ESP_ZB_ZCL_CLUSTER_ID_BINARY_INPUT, 
-        ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, 
-        ESP_ZB_ZCL_ATTR_BINARY_INPUT_PRESENT_VALUE_ID, 
-        &value, 
-        false
-    );
+    static int64_t last_edge = 0;
+    static int64_t pressed_at = -1;
+    int64_t now = esp_timer_get_time();
+    int level = gpio_get_level(ZOOM_BUTTON_PIN);
+    // level triggered so a press also wakes the chip from light sleep,
+    // wait for the opposite level next
+    gpio_wakeup_enable(ZOOM_BUTTON_PIN, level ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    if (now - last_edge > 50 * 1000) { // debounce
+        if (!level) {
+            pressed_at = now;
+        } else if (pressed_at >= 0) {
+            BaseType_t woken = pdFALSE;
+            xEventGroupSetBitsFromISR(app_events, now - pressed_at >= LONG_PRESS_US ? EVT_AUTOTUNE_PRESSED : EVT_ZOOM_PRESSED, &woken);
+            portYIELD_FROM_ISR(woken);
+            pressed_at = -1;
+        }
+    }
+    last_edge = now;
 }
 
-void report_temperature(float temp)
+// tuned pid gains are kept in nvs and override the Kconfig defaults
+static void load_pid_gains()
 {
-    uint16_t temp_zb = (uint16_t)(temp*100.);
-    esp_zb_zcl_set_attribute_val(
-        HA_ESP_ENDPOINT, 
-        ESP_ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT, 
-        ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, 
-        ESP_ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID, 
-        &temp_zb, 
-        false
-    );
+    nvs_handle_t handle;
+    if (nvs_open("control", NVS_READONLY, &handle) != ESP_OK) return;
+    pid_gains_t gains;
+    size_t size = sizeof(gains);
+    if (nvs_get_blob(handle, "pid", &gains, &size) == ESP_OK && size == sizeof(gains)) {
+        pid_set_gains(&gains);
+    }
+    nvs_close(handle);
 }
 
-void draw_graph()
+static void save_pid_gains(const pid_gains_t *gains)
 {
-    gfx_clear_area(0, 32, 128, 32);
-    float max_temp = 0;
-    float min_temp = 100;
-    for(int i = 0; i < 128; i++){
-        if(temps[i] > max_temp && temps[i] >= 0) max_temp = temps[i] + 0.5;
-        if(temps[i] < min_temp && temps[i] >= 0) min_temp = temps[i] - 0.5;
+    nvs_handle_t handle;
+    if (nvs_open("control", NVS_READWRITE, &handle) != ESP_OK) return;
+    if (nvs_set_blob(handle, "pid", gains, sizeof(*gains)) == ESP_OK) {
+        nvs_commit(handle);
     }
+    nvs_close(handle);
+}
 
-    float pxpt = (32.0) / (max_temp - min_temp);
-    ESP_LOGI(TAG, "index: %d, max_temp: %f, min_temp: %f", temp_index, max_temp, min_temp);
+// feed a sample from the flash log back into the in-ram history, uptime
+// restarts every boot so the gaps between runs are closed up
+static void replay_record(const telemetry_record_t *record, void *ctx)
+{
+    static telemetry_record_t prev;
+    static bool first = true;
+    if(!first){
+        if(record->boot == prev.boot && record->time_s > prev.time_s)
+            history_time_offset += record->time_s - prev.time_s;
+        else
+            history_time_offset += CONFIG_BEER_TELEMETRY_INTERVAL;
+    }
+    history_append(record->temp, history_time_offset);
+    prev = *record;
+    first = false;
+}
+
+// boot progress since reset, to see what holds up the control loop
+static void boot_phase(const char *phase)
+{
+    ESP_LOGI(TAG, "boot: %s at %ld ms", phase, (long)(esp_timer_get_time() / 1000));
+}
 
-    int prev_y = -1.0f;
-    for(int i = 0; i < 128; i++){
-        int index = (temp_index + i + 1) % 128;
+// hand the state to a later stage, a stalled stage loses samples instead
+// of holding up control
+static void publish(spsc_ring_t *ring, TaskHandle_t task, const control_state_t *state)
+{
+    // the display may still be coming up
+    if(task == NULL) return;
+    if(!spsc_ring_push(ring, state)){
+        ESP_LOGW(TAG, "stage behind, %lu samples dropped", (unsigned long)spsc_ring_dropped(ring));
+    }
+    xTaskNotifyGive(task);
+}
 
-        if(temps[index] < 0) continue;
-        int y = pxpt * (temps[index] - min_temp);
+// fill in the rest of the state and hand it to the display and reporting
+static void publish_state(control_state_t *state, const temp_sample_t *sample, int64_t timestamp_us)
+{
+    state->timestamp_us = timestamp_us;
+    state->controller = control_get_ops()->name;
+    for(int i = 0; i < EXAMPLE_ONEWIRE_MAX_DS18B20; i++){
+        state->probe_temps[i] = state->temp != TEMP_INVALID && i < sample->count && fusion_get_channel(i)->valid ?
+                                fusion_get_channel(i)->last : TEMP_INVALID;
+    }
+    publish(&display_ring, display_task_handle, state);
+    publish(&report_ring, report_task_handle, state);
+}
 
-        if(prev_y < 0){
-            gfx_set_pixel(i, 64 - y);
-        } else if(y > prev_y){
-            gfx_fill_area(i, 64 - y, 1, y - prev_y);
-        } else if(y < prev_y){
-            gfx_fill_area(i, 64 - prev_y, 1, prev_y - y);
+// sensor sample in, heater duty out, nothing in here waits on i2c or the radio
+static void control_task(void *pvParameters)
+{
+    temp_sample_t sample = {0};
+    control_state_t state;
+    int64_t next_publish_us = 0;
+    bool running = false;
+    for(;;){
+        // a fresh conversion, or the estimate once a control period passes without one
+        bool fresh = temp_sensor_receive(&sample, pdMS_TO_TICKS(CONTROL_PERIOD_MS));
+        int64_t now = fresh ? sample.timestamp_us : esp_timer_get_time();
+        int64_t start = profile_start();
+        int16_t fused;
+        if(fresh){
+            profile_loop(start, TEMP_SENSOR_PERIOD_US(sample.bits));
+
+            // combine all probes, skipping outliers and stuck sensors
+            if(fusion_update(&sample, &fused)){
+                state.temp = estimator_correct(fused, sample.bits, now);
+            } else {
+                ESP_LOGW(TAG, "no usable temperature sensor");
+                state.temp = TEMP_INVALID;
+                // or the estimate would carry on from the last good reading
+                estimator_reset();
+            }
         } else {
-            gfx_set_pixel(i, 64 - y);
+            // invalid too once the last conversion is too old, the bus may be gone
+            state.temp = estimator_predict(now);
+        }
+
+        if(state.temp == TEMP_INVALID){
+            // nothing to control on, the heater must not keep its last duty
+            heater_set_duty(0);
+            estimator_set_duty(0, now);
+            control_reset();
+            profile_end(PROFILE_CONTROL, start);
+
+            // the display and the reports show the fault
+            if(now < next_publish_us) continue;
+            next_publish_us = now + PUBLISH_PERIOD_US;
+            state.duty = 0;
+            state.ambient = fusion_get_ambient();
+            state.eta_s = FEED_FORWARD_ETA_UNKNOWN;
+            publish_state(&state, &sample, now);
+            continue;
         }
 
-        prev_y = y;
+        // the controller picks a duty, the heater spreads it over its pwm window
+        EventBits_t bits = xEventGroupClearBits(app_events, EVT_AUTOTUNE_PRESSED);
+        if(bits & EVT_AUTOTUNE_PRESSED){
+            control_start_autotune(save_pid_gains);
+        }
+        // the heat lost to the air is made up before the beer has cooled
+        int16_t ambient = fusion_get_ambient();
+        control_set_feed_forward(feed_forward_update(state.temp, ambient, target_temp, now));
+        state.duty = 0;
+        if(bits & EVT_HEATER_ENABLED){
+            state.duty = control_update(state.temp, target_temp, now);
+        } else {
+            control_reset();
+        }
+        heater_set_duty(state.duty);
+        estimator_set_duty(state.duty, now);
+        profile_end(PROFILE_CONTROL, start);
+        if(!running){
+            boot_phase("control running");
+            running = true;
+        }
+        if(!fresh) continue;
+
+#if CONFIG_BEER_ADAPTIVE_RESOLUTION
+        // coarse and fast while far from the target, precise close to it
+        temp_sensor_set_resolution(estimator_resolution(target_temp));
+#endif
+
+        // display, history and reports keep a steady pace whatever the resolution
+        if(now < next_publish_us - TEMP_SENSOR_PERIOD_US(sample.bits) / 2) continue;
+        next_publish_us = now - next_publish_us > PUBLISH_PERIOD_US ? now + PUBLISH_PERIOD_US : next_publish_us + PUBLISH_PERIOD_US;
+
+        state.ambient = ambient;
+        state.eta_s = feed_forward_eta_s(state.temp, target_temp, bits & EVT_HEATER_ENABLED);
+        publish_state(&state, &sample, sample.timestamp_us);
     }
-    
 }
 
-static void temp_task(void *pvParameters)
+// the reporting engine decides what is worth a radio frame
+static void report_task(void *pvParameters)
 {
+    control_state_t state;
     for(;;){
-        vTaskDelay(100 / portTICK_PERIOD_MS);
-
-        float temp = get_temp();
-
-        char temp_str[10];
-        sprintf(temp_str, "%.2f C ", temp);
-        gfx_draw_text(0, 10, temp_str);
-
-        temps[temp_index] = temp;
-
-        draw_graph();
-        if(zb_connected)
-            report_temperature(temp);
-
-        // roughly keep temp at 25c by turning on/off the heater
-        if(temp < target_temp - temp_offset && switch_state){
-            gpio_set_level(HEATER_PIN, 1);
-            if(zb_connected)
-                report_output_binary_sensor(1);
-            gfx_draw_text(0, 20, "heat on ");
-        } else if(temp > target_temp + temp_offset || !switch_state){
-            gpio_set_level(HEATER_PIN, 0);
-            if(zb_connected)
-                report_output_binary_sensor(0);
-            gfx_draw_text(0, 20, "heat off");
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while(spsc_ring_pop(&report_ring, &state)){
+            if(xEventGroupGetBits(app_events) & EVT_ZB_CONNECTED){
+                int64_t start = profile_start();
+                zb_report_forecast(state.ambient, state.eta_s, feed_forward_loss());
+                zb_report_update(state.temp, state.duty, state.probe_temps, state.timestamp_us);
+                profile_end(PROFILE_REPORT, start);
+                zb_diag_update(state.timestamp_us);
+                zb_history_update();
+#if CONFIG_BEER_METER
+                meter_reading_t reading;
+                meter_get_reading(&reading);
+                zb_meter_update(&reading);
+#endif
+            }
         }
+    }
+}
+
+// the only task drawing to the framebuffer, it also keeps the history and log.
+// it feeds the widgets and renders whatever changed, from any task
+static void display_loop()
+{
+    control_state_t state;
+    for(;;){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while(spsc_ring_pop(&display_ring, &state)){
+            ui_set_readout(UI_TEMP, state.temp);
+            ui_set_duration(UI_ETA, state.eta_s);
+
+            uint32_t now_s = state.timestamp_us / 1000000;
+            bool valid = state.temp != TEMP_INVALID;
+            // a sensor fault leaves a gap in the graph and the log
+            if(valid) ui_graph_sample(history_append(state.temp, history_time_offset + now_s));
+            // the first press only wakes a dimmed or blank display
+            EventBits_t bits = xEventGroupClearBits(app_events, EVT_ZOOM_PRESSED);
+            if((bits & EVT_ZOOM_PRESSED) && !power_display_wake(state.timestamp_us)){
+                ui_graph_zoom();
+            }
+
+            char heat_str[12];
+            snprintf(heat_str, sizeof(heat_str), "%-4s %3d%%", state.controller, state.duty / 10);
+            ui_set_text(UI_HEAT, heat_str);
 
-        gfx_flush();
-        temp_index = (temp_index + 1) % 128;
+            if(valid) telemetry_log(state.temp, heater_is_on(), now_s);
+        }
+        int64_t start = profile_start();
+        if(ui_render()){
+            profile_end(PROFILE_RENDER, start);
+        }
+        // a blank panel keeps collecting dirty spans until it wakes up
+        if(power_update(heater_get_duty() == 0, esp_timer_get_time()) != POWER_DISPLAY_OFF){
+            start = profile_start();
+            gfx_flush();
+            profile_end(PROFILE_FLUSH, start);
+        }
     }
 }
 
@@ -148,7 +372,12 @@ static esp_err_t zb_attribute_handler(const esp_zb_zcl_set_attr_value_message_t
     if (message->info.dst_endpoint == HA_ESP_ENDPOINT){
         if (message->info.cluster == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF){
             if (message->attribute.id == ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID && message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_BOOL){
-                switch_state = message->attribute.data.value ? *(bool *)message->attribute.data.value : switch_state;
+                bool switch_state = message->attribute.data.value ? *(bool *)message->attribute.data.value : true;
+                if(switch_state){
+                    xEventGroupSetBits(app_events, EVT_HEATER_ENABLED);
+                } else {
+                    xEventGroupClearBits(app_events, EVT_HEATER_ENABLED);
+                }
                 gpio_set_level(GPIO_NUM_15, !switch_state);
                 ESP_LOGI(TAG, "Light sets to %s", switch_state ? "On" : "Off");
             }
@@ -166,6 +395,9 @@ static esp_err_t zb_action_handler(esp_zb_core_action_callback_id_t callback_id,
     case ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID:
         ret = zb_attribute_handler((esp_zb_zcl_set_attr_value_message_t *)message);
         break;
+    case ESP_ZB_CORE_CMD_CUSTOM_CLUSTER_REQ_CB_ID:
+        ret = zb_history_handle_command((esp_zb_zcl_custom_cluster_command_message_t *)message);
+        break;
     default:
         ESP_LOGW(TAG, "Receive Zigbee action(0x%x) callback", callback_id);
         break;
@@ -192,8 +424,8 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
                 esp_zb_bdb_start_top_level_commissioning(ESP_ZB_BDB_MODE_NETWORK_STEERING);
             } else {
                 ESP_LOGI(TAG, "Device connected");
-                zb_connected = true;
-                gfx_draw_text(112, 0, "zb");
+                xEventGroupSetBits(app_events, EVT_ZB_CONNECTED);
+                ui_set_icon(UI_ZB, true);
             }
         } else {
             ESP_LOGW(TAG, "%s failed with status: %s, retrying", esp_zb_zdo_signal_to_string(sig_type), esp_err_to_name(err_status));
@@ -201,6 +433,11 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
                                    ESP_ZB_BDB_MODE_INITIALIZATION, 1000);
         }
         break;
+#if CONFIG_BEER_POWER_SAVE
+    case ESP_ZB_COMMON_SIGNAL_CAN_SLEEP:
+        esp_zb_sleep_now();
+        break;
+#endif
     case ESP_ZB_BDB_SIGNAL_STEERING:
         if (err_status == ESP_OK) {
             esp_zb_ieee_addr_t extended_pan_id;
@@ -209,8 +446,8 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
                      extended_pan_id[7], extended_pan_id[6], extended_pan_id[5], extended_pan_id[4],
                      extended_pan_id[3], extended_pan_id[2], extended_pan_id[1], extended_pan_id[0],
                      esp_zb_get_pan_id(), esp_zb_get_current_channel(), esp_zb_get_short_address());
-            zb_connected = true;
-            gfx_draw_text(112, 0, "zb");
+            xEventGroupSetBits(app_events, EVT_ZB_CONNECTED);
+            ui_set_icon(UI_ZB, true);
         } else {
             ESP_LOGI(TAG, "Network steering was not successful (status: %s)", esp_err_to_name(err_status));
             esp_zb_scheduler_alarm((esp_zb_callback_t)bdb_start_top_level_commissioning_cb, ESP_ZB_BDB_MODE_NETWORK_STEERING, 1000);
@@ -224,7 +461,10 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
 
 static void esp_zb_task(void *pvParameters)
 {
-    // setup zigbee
+    // setup zigbee, the stack decides when the radio may sleep
+#if CONFIG_BEER_POWER_SAVE
+    esp_zb_sleep_enable(true);
+#endif
     esp_zb_cfg_t zb_nwk_cfg = ESP_ZB_ZED_CONFIG();
     esp_zb_init(&zb_nwk_cfg);
 
@@ -262,7 +502,7 @@ static void esp_zb_task(void *pvParameters)
 
     // cluster temperature measurement (0 to 30 degree celsius)
     esp_zb_temperature_meas_cluster_cfg_t temperature_meas_cfg = {
-        .measured_value = 0xFFFF,
+        .measured_value = TEMP_INVALID,
         .min_value = 0,
         .max_value = 5000,
     };
@@ -283,6 +523,12 @@ static void esp_zb_task(void *pvParameters)
     esp_zb_cluster_list_add_on_off_cluster(esp_zb_cluster_list, esp_zb_on_off_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
     esp_zb_cluster_list_add_temperature_meas_cluster(esp_zb_cluster_list, esp_zb_temperature_meas_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
     esp_zb_cluster_list_add_binary_input_cluster(esp_zb_cluster_list, esp_zb_binary_input_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+    esp_zb_cluster_list_add_custom_cluster(esp_zb_cluster_list, zb_report_warmer_cluster_create(), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+    esp_zb_cluster_list_add_custom_cluster(esp_zb_cluster_list, zb_diag_cluster_create(), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+    esp_zb_cluster_list_add_custom_cluster(esp_zb_cluster_list, zb_history_cluster_create(), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+#if CONFIG_BEER_METER
+    zb_meter_add_clusters(esp_zb_cluster_list);
+#endif
 
     // create endpoint list
     esp_zb_ep_list_t *esp_zb_ep_list = esp_zb_ep_list_create();
@@ -293,43 +539,24 @@ static void esp_zb_task(void *pvParameters)
     };
     esp_zb_ep_list_add_ep(esp_zb_ep_list, esp_zb_cluster_list, endpoint_config);
 
+    // one temperature sensor endpoint per probe
+    for(int i = 0; i < temp_sensor_count(); i++){
+        esp_zb_cluster_list_t *sensor_cluster_list = esp_zb_zcl_cluster_list_create();
+        esp_zb_cluster_list_add_temperature_meas_cluster(sensor_cluster_list, esp_zb_temperature_meas_cluster_create(&temperature_meas_cfg), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+        esp_zb_endpoint_config_t sensor_endpoint_config = {
+            .endpoint = HA_ESP_SENSOR_ENDPOINT_BASE + i,
+            .app_profile_id = ESP_ZB_AF_HA_PROFILE_ID,
+            .app_device_id = ESP_ZB_HA_TEMPERATURE_SENSOR_DEVICE_ID,
+        };
+        esp_zb_ep_list_add_ep(esp_zb_ep_list, sensor_cluster_list, sensor_endpoint_config);
+    }
+
     // Register device
     esp_zb_device_register(esp_zb_ep_list);
     esp_zb_core_action_handler_register(zb_action_handler);
 
-    esp_zb_zcl_reporting_info_t reporting_info = {
-        .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_SRV,
-        .ep = HA_ESP_ENDPOINT,
-        .cluster_id = ESP_ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT,
-        .cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
-        .dst.profile_id = ESP_ZB_AF_HA_PROFILE_ID,
-        .u.send_info.min_interval = 1,
-        .u.send_info.max_interval = 0,
-        .u.send_info.def_min_interval = 1,
-        .u.send_info.def_max_interval = 0,
-        .u.send_info.delta.u16 = 1,
-        .attr_id = ESP_ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID,
-        .manuf_code = ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC,
-    };
-    esp_zb_zcl_update_reporting_info(&reporting_info);
-
-    // setup automatic reporting for binary input
-    esp_zb_zcl_reporting_info_t reporting_info_binary = {
-        .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_SRV,
-        .ep = HA_ESP_ENDPOINT,
-        .cluster_id = ESP_ZB_ZCL_CLUSTER_ID_BINARY_INPUT,
-        .cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
-        .dst.profile_id = ESP_ZB_AF_HA_PROFILE_ID,
-        .u.send_info.min_interval = 1,
-        .u.send_info.max_interval = 0,
-        .u.send_info.def_min_interval = 1,
-        .u.send_info.def_max_interval = 0,
-        .u.send_info.delta.u8 = 1,
-        .u.send_info.reported_value.u8 = 0,
-        .attr_id = ESP_ZB_ZCL_ATTR_BINARY_INPUT_PRESENT_VALUE_ID,
-        .manuf_code = ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC,
-    };
-    esp_zb_zcl_update_reporting_info(&reporting_info_binary);
+    // reporting is done by zb_report instead of the stack's change reporting
+    zb_report_init(temp_sensor_count());
 
     // start zigbee
     esp_zb_set_primary_network_channel_set(ESP_ZB_PRIMARY_CHANNEL_MASK);
@@ -337,35 +564,16 @@ static void esp_zb_task(void *pvParameters)
     esp_zb_stack_main_loop();
 }
 
-void app_main(void)
+// the display and the history behind it come up in parallel with the rest
+// of the boot, then the same task keeps drawing
+static void display_task(void *pvParameters)
 {
-    // setup onboard led
-    gpio_set_direction(GPIO_NUM_15, GPIO_MODE_OUTPUT);
-    gpio_set_level(GPIO_NUM_15, 0);
-
-    // setup heater gpio
-    gpio_set_direction(HEATER_PIN, GPIO_MODE_OUTPUT);
-    gpio_set_level(HEATER_PIN, 0);
-
-    // setup temperature sensor
-    for(int i = 0; i < 128; i++){
-        temps[i] = -1.0f;
+    // restore the recent history from the telemetry log
+    if(telemetry_init() == ESP_OK){
+        telemetry_recover(CONFIG_BEER_TELEMETRY_RECOVER_SAMPLES, replay_record, NULL);
+        history_time_offset += CONFIG_BEER_TELEMETRY_INTERVAL;
     }
-    init_temp_sensor();
-
-    // use internal antenna
-    gpio_set_direction(GPIO_NUM_3, GPIO_MODE_OUTPUT);
-    gpio_set_level(GPIO_NUM_3, 0);
-    gpio_set_direction(GPIO_NUM_14, GPIO_MODE_OUTPUT);
-    gpio_set_level(GPIO_NUM_14, 0);
-
-    // setup zigbee
-    esp_zb_platform_config_t config = {
-        .radio_config = ESP_ZB_DEFAULT_RADIO_CONFIG(),
-        .host_config = ESP_ZB_DEFAULT_HOST_CONFIG(),
-    };
-    ESP_ERROR_CHECK(nvs_flash_init());
-    ESP_ERROR_CHECK(esp_zb_platform_config(&config));
+    boot_phase("history restored");
 
     i2c_master_bus_config_t i2c_bus_conf = {
         .clk_source = I2C_CLK_SRC_DEFAULT,
@@ -391,44 +599,122 @@ void app_main(void)
     esp_lcd_new_panel_io_i2c(bus_handle, &io_config, &io_handle);
 
     esp_lcd_panel_handle_t panel_handle = NULL;
+    // the sh1106 shares the ssd1306 driver for display on/off and mirroring,
+    // gfx initialises it and sends its frames
+    esp_lcd_panel_ssd1306_config_t ssd1306_config = {
+        .height = TEST_LCD_V_RES,
+    };
     esp_lcd_panel_dev_config_t panel_config = {
         .bits_per_pixel = 1,
         .reset_gpio_num = -1,
+        .vendor_config = &ssd1306_config,
     };
     esp_lcd_new_panel_ssd1306(io_handle, &panel_config, &panel_handle);
     esp_lcd_panel_reset(panel_handle);
+#if CONFIG_BEER_DISPLAY_SH1106
+    gfx_sh1106_init(io_handle);
+#else
     esp_lcd_panel_init(panel_handle);
+#endif
     // turn on display
     esp_lcd_panel_disp_on_off(panel_handle, true);
 
     // mirror the display
     esp_lcd_panel_mirror(panel_handle, true, true);
+    power_display_init(io_handle, panel_handle, esp_timer_get_time());
 
-    
-
-    gfx_init(panel_handle, TEST_LCD_H_RES, TEST_LCD_V_RES);
+    gfx_init(io_handle, panel_handle);
+#if CONFIG_BEER_DISPLAY_ASYNC_FLUSH
+    // below the display task, so rendering never waits on the bus
+    profile_register_task(gfx_start_flush_task(io_handle, FLUSH_TASK_PRIORITY));
+#endif
 
-    gfx_clear_area(0, 0, 128, 64);
-    gfx_draw_text(0, 0, "Beer warmer");
+    ui_init();
     gfx_flush();
+    boot_phase("display on");
+
+    // control publishes to the display from here on, widget updates wake it too
+    ui_set_render_task(xTaskGetCurrentTaskHandle());
+    display_task_handle = xTaskGetCurrentTaskHandle();
+    display_loop();
+}
 
-    // while(1){
+void app_main(void)
+{
+    // the heater starts enabled, like the on/off cluster
+    app_events = xEventGroupCreateStatic(&app_events_buf);
+    xEventGroupSetBits(app_events, EVT_HEATER_ENABLED);
+    spsc_ring_init(&display_ring, display_items, sizeof(control_state_t), STAGE_RING_LEN);
+    spsc_ring_init(&report_ring, report_items, sizeof(control_state_t), STAGE_RING_LEN);
 
-    //     temps[temp_index] = temp_index > 0 ? temps[(temp_index - 1) % 128] + ((rand() % 2) - 0.5) : temps[119] + ((rand() % 2) - 0.5);
+    // setup onboard led
+    gpio_set_direction(GPIO_NUM_15, GPIO_MODE_OUTPUT);
+    gpio_set_level(GPIO_NUM_15, 0);
+
+    // setup heater pwm
+    heater_init(HEATER_PIN);
 
-    //     char temp_str[10];
-    //     sprintf(temp_str, "%.2f C ", temps[temp_index]);
-    //     gfx_draw_text(0, 10, temp_str);
+#if CONFIG_BEER_METER
+    // heater current and supply voltage
+    ESP_ERROR_CHECK(meter_init());
+#endif
 
-    //     draw_graph();
-    //     gfx_flush();
+    // setup zoom button
+    gpio_set_direction(ZOOM_BUTTON_PIN, GPIO_MODE_INPUT);
+    gpio_set_pull_mode(ZOOM_BUTTON_PIN, GPIO_PULLUP_ONLY);
+    gpio_wakeup_enable(ZOOM_BUTTON_PIN, GPIO_INTR_LOW_LEVEL);
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(ZOOM_BUTTON_PIN, zoom_button_isr, NULL);
 
-    //     temp_index = (temp_index + 1) % 128;
-    // }
+    // light sleep between conversions, the button wakes the chip up
+    ESP_ERROR_CHECK(power_init());
+#if CONFIG_BEER_POWER_SAVE
+    esp_sleep_enable_gpio_wakeup();
+#endif
 
-    // task for keeping track of temperature
-    xTaskCreate(temp_task, "temp_task", 4096, NULL, 5, NULL);
+    // nvs first, it holds the pid gains and the probe rom codes
+    ESP_ERROR_CHECK(nvs_flash_init());
+    boot_phase("nvs");
+
+    // setup heater control
+    load_pid_gains();
+    control_init();
+
+    // setup temperature sensor
+    init_temp_sensor();
+    fusion_init();
+    temp_sensor_start();
+    boot_phase("sensors");
+
+    // the control loop runs before the display and the radio are up,
+    // report first, so its handle exists before control publishes
+    report_task_handle = xTaskCreateStatic(report_task, "report", REPORT_TASK_STACK, NULL, REPORT_TASK_PRIORITY,
+                                           report_task_stack, &report_task_buf);
+    profile_register_task(report_task_handle);
+    profile_register_task(xTaskCreateStatic(control_task, "control", CONTROL_TASK_STACK, NULL, CONTROL_TASK_PRIORITY,
+                                            control_task_stack, &control_task_buf));
+    profile_register_task(xTaskCreateStatic(display_task, "display", DISPLAY_TASK_STACK, NULL, DISPLAY_TASK_PRIORITY,
+                                            display_task_stack, &display_task_buf));
+
+    // use internal antenna
+    gpio_set_direction(GPIO_NUM_3, GPIO_MODE_OUTPUT);
+    gpio_set_level(GPIO_NUM_3, 0);
+    gpio_set_direction(GPIO_NUM_14, GPIO_MODE_OUTPUT);
+    gpio_set_level(GPIO_NUM_14, 0);
+
+    // setup zigbee
+    esp_zb_platform_config_t config = {
+        .radio_config = ESP_ZB_DEFAULT_RADIO_CONFIG(),
+        .host_config = ESP_ZB_DEFAULT_HOST_CONFIG(),
+    };
+    ESP_ERROR_CHECK(esp_zb_platform_config(&config));
 
     // task for zigbee
-    xTaskCreate(esp_zb_task, "Zigbee_main", 4096, NULL, 5, NULL);
+    profile_register_task(xTaskCreateStatic(esp_zb_task, "Zigbee_main", ZIGBEE_TASK_STACK, NULL, ZIGBEE_TASK_PRIORITY,
+                                            zigbee_task_stack, &zigbee_task_buf));
+    boot_phase("zigbee started");
+
+#if CONFIG_BEER_CONSOLE
+    ESP_ERROR_CHECK(console_start());
+#endif
 }
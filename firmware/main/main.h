@@ -1,10 +1,12 @@
 #include "esp_zigbee_core.h"
+#include "sdkconfig.h"
 
 /* Zigbee configuration */
 #define INSTALLCODE_POLICY_ENABLE false
 #define ED_AGING_TIMEOUT ESP_ZB_ED_AGING_TIMEOUT_64MIN
-#define ED_KEEP_ALIVE 3000
+#define ED_KEEP_ALIVE CONFIG_BEER_ZB_KEEP_ALIVE // also the poll interval of the end device
 #define HA_ESP_ENDPOINT 10
+#define HA_ESP_SENSOR_ENDPOINT_BASE 11 // one endpoint per DS18B20 probe
 #define ESP_ZB_PRIMARY_CHANNEL_MASK ESP_ZB_TRANSCEIVER_ALL_CHANNELS_MASK 
 
 #define ESP_ZB_ZED_CONFIG()                               \
@@ -28,12 +30,12 @@
     }
 
 
-#define TEST_LCD_V_RES          64
-#define TEST_LCD_H_RES          128
+#define TEST_LCD_V_RES          CONFIG_BEER_DISPLAY_HEIGHT
+#define TEST_LCD_H_RES          CONFIG_BEER_DISPLAY_WIDTH
 
 #define TEST_I2C_SDA_GPIO       22
 #define TEST_I2C_SCL_GPIO       23
 
 #define TEST_I2C_DEV_ADDR       0x3C
 
-#define TEST_LCD_PIXEL_CLOCK_HZ (400 * 1000)
\ No newline at end of file
+#define TEST_LCD_PIXEL_CLOCK_HZ CONFIG_BEER_DISPLAY_I2C_HZ
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "meter.h"
+#include "adc_hal.h"
+#include "heater.h"
+#include "profile.h"
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_check.h"
+#include "esp_log.h"
+
+#define METER_CURRENT_CHANNEL CONFIG_BEER_METER_CURRENT_CHANNEL
+#define METER_VOLTAGE_CHANNEL CONFIG_BEER_METER_VOLTAGE_CHANNEL
+#define METER_CURRENT_SCALE   CONFIG_BEER_METER_CURRENT_SCALE   // mA per V at the pin
+#define METER_VOLTAGE_SCALE   CONFIG_BEER_METER_VOLTAGE_SCALE   // mV per V at the pin
+#define METER_PERIOD_MS       CONFIG_BEER_METER_PERIOD_MS
+#define METER_OPEN_MA         CONFIG_BEER_METER_OPEN_MA
+// ten 50 Hz or twelve 60 Hz periods, so the rms doesn't depend on the phase
+#define METER_WINDOW_MS       200
+// with the heater off there is only the supply voltage to follow
+#define METER_IDLE_FACTOR     10
+// windows in a row without current before the element counts as open
+#define METER_OPEN_WINDOWS    2
+#define METER_TASK_PRIORITY   2
+#define METER_TASK_STACK      3072
+
+#define CH_CURRENT 0
+#define CH_VOLTAGE 1
+
+static const char *TAG = "METER";
+
+static StaticTask_t meter_task_buf;
+static StackType_t meter_task_stack[METER_TASK_STACK];
+
+static portMUX_TYPE reading_lock = portMUX_INITIALIZER_UNLOCKED;
+static meter_reading_t reading;
+
+static uint32_t last_on_ms;
+static uint64_t energy_mw_ms;
+static int open_windows = 0;
+
+// ac signals ride on a mid-supply bias, only their rms counts
+static uint32_t pin_mv(const adc_hal_result_t *result)
+{
+#if CONFIG_BEER_METER_AC
+    return result->rms_mv;
+#else
+    return result->mean_mv > 0 ? result->mean_mv : 0;
+#endif
+}
+
+static void meter_window()
+{
+    adc_hal_result_t results[2];
+    uint32_t switches = heater_switch_count();
+    bool on = heater_is_on();
+    if (adc_hal_sample(METER_WINDOW_MS, results) != ESP_OK) return;
+    // the current only means something when the heater didn't switch meanwhile
+    bool stable = switches == heater_switch_count();
+
+    meter_reading_t r;
+    portENTER_CRITICAL(&reading_lock);
+    r = reading;
+    portEXIT_CRITICAL(&reading_lock);
+
+    r.timestamp_us = esp_timer_get_time();
+    r.voltage_mv = (uint64_t)pin_mv(&results[CH_VOLTAGE]) * METER_VOLTAGE_SCALE / 1000;
+    if (stable) {
+        uint32_t current_ma = (uint64_t)pin_mv(&results[CH_CURRENT]) * METER_CURRENT_SCALE / 1000;
+        r.current_ma = on ? current_ma : 0;
+        if (on) {
+            // resistive heater, the power factor is one
+            r.power_mw = (uint64_t)r.voltage_mv * current_ma / 1000;
+
+            bool open = current_ma < METER_OPEN_MA;
+            open_windows = open ? open_windows + 1 : 0;
+            if (open_windows >= METER_OPEN_WINDOWS && !r.open_element) {
+                ESP_LOGE(TAG, "heater on but only %lu mA flowing, open element?", (unsigned long)current_ma);
+                r.open_element = true;
+            } else if (!open && r.open_element) {
+                ESP_LOGW(TAG, "heater current is back, %lu mA", (unsigned long)current_ma);
+                r.open_element = false;
+            }
+        }
+    }
+
+    // energy is the on time of the output at the last measured power
+    uint32_t on_ms = heater_on_time_ms();
+    energy_mw_ms += (uint64_t)r.power_mw * (uint32_t)(on_ms - last_on_ms);
+    last_on_ms = on_ms;
+    r.energy_mwh = energy_mw_ms / 3600000;
+
+    portENTER_CRITICAL(&reading_lock);
+    reading = r;
+    portEXIT_CRITICAL(&reading_lock);
+    ESP_LOGD(TAG, "%lu mV, %lu mA, %lu mW, %llu mWh", (unsigned long)r.voltage_mv, (unsigned long)r.current_ma,
+             (unsigned long)r.power_mw, (unsigned long long)r.energy_mwh);
+}
+
+static void meter_task(void *pvParameters)
+{
+    for(;;){
+        meter_window();
+        vTaskDelay(pdMS_TO_TICKS(heater_get_duty() ? METER_PERIOD_MS : METER_PERIOD_MS * METER_IDLE_FACTOR));
+    }
+}
+
+esp_err_t meter_init()
+{
+    const adc_channel_t channels[] = {
+        [CH_CURRENT] = METER_CURRENT_CHANNEL,
+        [CH_VOLTAGE] = METER_VOLTAGE_CHANNEL,
+    };
+    ESP_RETURN_ON_ERROR(init_adc(channels, 2), TAG, "adc init failed");
+    last_on_ms = heater_on_time_ms();
+    profile_register_task(xTaskCreateStatic(meter_task, "meter", METER_TASK_STACK, NULL, METER_TASK_PRIORITY,
+                                            meter_task_stack, &meter_task_buf));
+    return ESP_OK;
+}
+
+void meter_get_reading(meter_reading_t *out)
+{
+    portENTER_CRITICAL(&reading_lock);
+    *out = reading;
+    portEXIT_CRITICAL(&reading_lock);
+}
@@ -0,0 +1,21 @@
+#ifndef METER_H
+#define METER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// heater current and supply voltage, rms when the heater runs on mains
+typedef struct {
+    int64_t timestamp_us;   // end of the window, 0 before the first one
+    uint32_t voltage_mv;
+    uint32_t current_ma;    // 0 while the heater is off
+    uint32_t power_mw;      // power of the heater while it is on
+    uint64_t energy_mwh;    // since boot
+    bool open_element;      // heater switched on but no current flows
+} meter_reading_t;
+
+esp_err_t meter_init();
+void meter_get_reading(meter_reading_t *reading);
+
+#endif // METER_H
@@ -1,84 +1,506 @@
-
 #include "oled_gfx.h"
 #include "string.h"
 
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_vendor.h"
 #include "esp_lcd_panel_ops.h"
+#if CONFIG_BEER_DISPLAY_ASYNC_FLUSH
+#include "freertos/semphr.h"
+#endif
+
+#include "font8x8_basic_pages.h"
 
-#include "font8x8_basic.h"
+// approximate cost in bytes of starting a draw_bitmap transfer: the column
+// and page address commands plus the extra i2c start/address/control bytes
+#define GFX_FLUSH_OVERHEAD 12
+#define GFX_FLUSH_TASK_STACK 2048
+
+#if CONFIG_BEER_DISPLAY_SH1106
+#define SH1106_CMD_COLUMN_LOW   0x00
+#define SH1106_CMD_COLUMN_HIGH  0x10
+#define SH1106_CMD_PAGE         0xB0
+// pages are sent one by one anyway, a merged rectangle only adds bytes
+#define GFX_MERGE_PAGES 0
+#else
+#define GFX_MERGE_PAGES 1
+#endif
 
 struct oled_gfx gfx;
 
-char* display_buffer = NULL;
+// drawing goes to display_buffer, gfx_flush copies the dirty spans to
+// frame_buffer, which the panel is sent from
+static char display_buffer[GFX_PAGES * GFX_WIDTH];
+static char frame_buffer[GFX_PAGES * GFX_WIDTH];
+static char flush_buffer[GFX_PAGES * GFX_WIDTH];   // one rectangle packed for the transfer
+
+// dirty column span per page, x0 >= x1 means the page is clean
+struct gfx_span {
+    int x0;
+    int x1;
+};
+static struct gfx_span dirty[GFX_PAGES];
+// spans of frame_buffer submitted but not sent yet
+static struct gfx_span pending[GFX_PAGES];
+
+static struct gfx_flush_stats flush_stats;
+
+#if CONFIG_BEER_DISPLAY_ASYNC_FLUSH
+// held only for copies between the buffers, never across a transfer
+static portMUX_TYPE frame_lock = portMUX_INITIALIZER_UNLOCKED;
+#define FRAME_LOCK()    portENTER_CRITICAL(&frame_lock)
+#define FRAME_UNLOCK()  portEXIT_CRITICAL(&frame_lock)
+static TaskHandle_t flush_task = NULL;
+static SemaphoreHandle_t trans_done = NULL;
+static StaticSemaphore_t trans_done_buf;
+static StaticTask_t flush_task_buf;
+static StackType_t flush_task_stack[GFX_FLUSH_TASK_STACK];
+#else
+#define FRAME_LOCK()
+#define FRAME_UNLOCK()
+#endif
+
+static inline void mark_dirty(int page, int x0, int x1)
+{
+    if (x0 < dirty[page].x0) dirty[page].x0 = x0;
+    if (x1 > dirty[page].x1) dirty[page].x1 = x1;
+}
+
+static inline void mark_clean(struct gfx_span *span)
+{
+    span->x0 = GFX_WIDTH;
+    span->x1 = 0;
+}
+
+// byte of column x in page, the multiply is a shift for every panel we have
+static inline char *page_byte(char *buffer, int page, int x)
+{
+    return &buffer[page * GFX_WIDTH + x];
+}
 
-void gfx_init(esp_lcd_panel_handle_t panel_handle, int width, int height)
+void gfx_init(esp_lcd_panel_io_handle_t io_handle, esp_lcd_panel_handle_t panel_handle)
 {
+    gfx.io_handle = io_handle;
     gfx.panel_handle = panel_handle;
-    gfx.width = width;
-    gfx.height = height;
-    display_buffer = (char*)calloc(1, width*height/8);
+    for (int page = 0; page < GFX_PAGES; page++) {
+        mark_clean(&pending[page]);
+    }
+
+    // the panel contents are unknown, so the first flush sends everything
+    gfx_mark_dirty(0, 0, GFX_WIDTH, GFX_HEIGHT);
+}
+
+void gfx_mark_dirty(int x, int y, int w, int h)
+{
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > GFX_WIDTH) w = GFX_WIDTH - x;
+    if (y + h > GFX_HEIGHT) h = GFX_HEIGHT - y;
+    if (w <= 0 || h <= 0) return;
+
+    for (int page = y / 8; page <= (y + h - 1) / 8; page++) {
+        mark_dirty(page, x, x + w);
+    }
+}
+
+// merge w column bytes into one page under mask, shifted left (down) or
+// right (up) by shift bits, and mark only the bytes that really changed
+static void blit_page(int page, int x, int w, const uint8_t *columns, int shift, uint8_t mask)
+{
+    uint8_t *row = (uint8_t*)page_byte(display_buffer, page, x);
+    int first = w, last = -1;
+
+    for (int i = 0; i < w; i++) {
+        uint8_t value = shift >= 0 ? columns[i] << shift : columns[i] >> -shift;
+        uint8_t next = (row[i] & ~mask) | (value & mask);
+        if (next != row[i]) {
+            row[i] = next;
+            if (i < first) first = i;
+            last = i;
+        }
+    }
+    if (last >= 0) mark_dirty(page, x + first, x + last + 1);
 }
 
+static void blit(int x, int y, int w, const uint8_t *columns, uint8_t rows)
+{
+    if (x < 0) { columns -= x; w += x; x = 0; }
+    if (x + w > GFX_WIDTH) w = GFX_WIDTH - x;
+    if (w <= 0 || y <= -8 || y >= GFX_HEIGHT) return;
+
+    int page = y >> 3;      // floor division, y may be negative
+    int shift = y & 7;
+
+    // 8 aligned: every column byte lands in exactly one page byte
+    if (page >= 0) {
+        blit_page(page, x, w, columns, shift, rows << shift);
+    }
+    // unaligned: the bottom of the glyph spills into the next page
+    if (shift && page + 1 < GFX_PAGES) {
+        blit_page(page + 1, x, w, columns, shift - 8, rows >> (8 - shift));
+    }
+}
+
+void gfx_blit_columns(int x, int y, int w, const uint8_t *columns)
+{
+    blit(x, y, w, columns, 0xFF);
+}
+
+// one byte per row with bit n as column n, so at most 8 columns wide, wider
+// bitmaps are rejected. the rows are transposed into page columns 8 at a time
 void gfx_draw_bitmap(int x, int y, int w, int h, const char *bitmap)
 {
-    for(int y1 = 0; y1 < h; y1++){
-        for(int x1 = 0; x1 < w; x1++){
-            if(bitmap[y1] & (1 << x1)){
-                gfx_set_pixel(x + x1, y + y1);
-            } else {
-                gfx_clear_pixel(x + x1, y + y1);
+    uint8_t columns[8];
+    if (w <= 0 || w > 8) return;
+    for (int y0 = 0; y0 < h; y0 += 8) {
+        int n = h - y0 < 8 ? h - y0 : 8;
+        for (int x1 = 0; x1 < w; x1++) {
+            uint8_t col = 0;
+            for (int y1 = 0; y1 < n; y1++) {
+                col |= (((uint8_t)bitmap[y0 + y1] >> x1) & 1) << y1;
             }
+            columns[x1] = col;
         }
+        blit(x, y + y0, w, columns, 0xFF >> (8 - n));
     }
 }
 
-void gfx_clear_area(int x, int y, int w, int h)
+// set or clear w bytes under a full page mask, touching and marking only the
+// run between the first and last byte that differ from the fill value
+static void fill_page_full(int page, int x, int w, uint8_t fill)
+{
+    uint8_t *row = (uint8_t*)page_byte(display_buffer, page, x);
+    int first = 0, last = w - 1;
+
+    while (first < w && row[first] == fill) first++;
+    if (first == w) return;
+    while (row[last] == fill) last--;
+
+    memset(&row[first], fill, last - first + 1);
+    mark_dirty(page, x + first, x + last + 1);
+}
+
+static void xor_page_full(int page, int x, int w)
 {
-    for(int y1 = y; y1 < y+h; y1++){
-        for(int x1 = x; x1 < x+w; x1++){
-            gfx_clear_pixel(x1, y1);
+    uint8_t *row = (uint8_t*)page_byte(display_buffer, page, x);
+    int i = 0;
+
+    // bytes up to a word boundary, then whole words, then the tail. the words
+    // go through memcpy so the buffer isn't accessed as another type, with the
+    // alignment known it is still a single load and store
+    while (i < w && ((uintptr_t)&row[i] & 3)) row[i++] ^= 0xFF;
+    for (; i + 4 <= w; i += 4) {
+        uint8_t *p = __builtin_assume_aligned(&row[i], 4);
+        uint32_t word;
+        memcpy(&word, p, 4);
+        word ^= 0xFFFFFFFF;
+        memcpy(p, &word, 4);
+    }
+    while (i < w) row[i++] ^= 0xFF;
+
+    mark_dirty(page, x, x + w);
+}
+
+static void fill_page_masked(int page, int x, int w, uint8_t mask, enum gfx_mode mode)
+{
+    uint8_t *row = (uint8_t*)page_byte(display_buffer, page, x);
+    int first = w, last = -1;
+
+    for (int i = 0; i < w; i++) {
+        uint8_t next = mode == GFX_MODE_SET ? row[i] | mask :
+                       mode == GFX_MODE_CLEAR ? row[i] & ~mask : row[i] ^ mask;
+        if (next != row[i]) {
+            row[i] = next;
+            if (i < first) first = i;
+            last = i;
         }
     }
+    if (last >= 0) mark_dirty(page, x + first, x + last + 1);
 }
 
-void gfx_fill_area(int x, int y, int w, int h)
+void gfx_fill_rect(int x, int y, int w, int h, enum gfx_mode mode)
 {
-    for(int y1 = y; y1 < y+h; y1++){
-        for(int x1 = x; x1 < x+w; x1++){
-            gfx_set_pixel(x1, y1);
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > GFX_WIDTH) w = GFX_WIDTH - x;
+    if (y + h > GFX_HEIGHT) h = GFX_HEIGHT - y;
+    if (w <= 0 || h <= 0) return;
+
+    int p0 = y / 8;
+    int p1 = (y + h - 1) / 8;
+    uint8_t top = 0xFF << (y % 8);
+    uint8_t bottom = 0xFF >> (7 - (y + h - 1) % 8);
+
+    for (int page = p0; page <= p1; page++) {
+        uint8_t mask = 0xFF;
+        if (page == p0) mask &= top;
+        if (page == p1) mask &= bottom;
+
+        if (mask != 0xFF) {
+            fill_page_masked(page, x, w, mask, mode);
+        } else if (mode == GFX_MODE_XOR) {
+            xor_page_full(page, x, w);
+        } else {
+            fill_page_full(page, x, w, mode == GFX_MODE_SET ? 0xFF : 0x00);
         }
     }
 }
 
+void gfx_clear_area(int x, int y, int w, int h)
+{
+    gfx_fill_rect(x, y, w, h, GFX_MODE_CLEAR);
+}
+
+void gfx_fill_area(int x, int y, int w, int h)
+{
+    gfx_fill_rect(x, y, w, h, GFX_MODE_SET);
+}
+
+void gfx_invert_area(int x, int y, int w, int h)
+{
+    gfx_fill_rect(x, y, w, h, GFX_MODE_XOR);
+}
+
+void gfx_draw_hline(int x, int y, int w, enum gfx_mode mode)
+{
+    gfx_fill_rect(x, y, w, 1, mode);
+}
+
+void gfx_draw_vline(int x, int y, int h, enum gfx_mode mode)
+{
+    gfx_fill_rect(x, y, 1, h, mode);
+}
+
 void gfx_set_pixel(uint8_t x, uint8_t y) {
-    if (x >= gfx.width || y >= gfx.height) return;  // Bounds check
+    if (x >= GFX_WIDTH || y >= GFX_HEIGHT) return;  // Bounds check
 
-    uint8_t page = y / 8;
-    uint8_t bit = y % 8;
+    uint8_t page = y >> 3;
+    uint8_t bit = y & 7;
 
-    display_buffer[page * gfx.width + x] |= (1 << bit);
+    char *byte = page_byte(display_buffer, page, x);
+    if (!(*byte & (1 << bit))) {
+        *byte |= (1 << bit);
+        mark_dirty(page, x, x + 1);
+    }
 }
 
 void gfx_clear_pixel(uint8_t x, uint8_t y) {
-    if (x >= gfx.width || y >= gfx.height) return;  // Bounds check
+    if (x >= GFX_WIDTH || y >= GFX_HEIGHT) return;  // Bounds check
 
-    uint8_t page = y / 8;
-    uint8_t bit = y % 8;
+    uint8_t page = y >> 3;
+    uint8_t bit = y & 7;
 
-    display_buffer[page * gfx.width + x] &= ~(1 << bit);
+    char *byte = page_byte(display_buffer, page, x);
+    if (*byte & (1 << bit)) {
+        *byte &= ~(1 << bit);
+        mark_dirty(page, x, x + 1);
+    }
 }
 
 void gfx_draw_text(int x, int y, const char *text)
 {
     int i = 0;
     while(text[i] != '\0'){
-        gfx_draw_bitmap(x + i*8, y, 8, 8, (const char*)&font8x8_basic[(int)text[i]]);
+        blit(x + i*8, y, 8, font8x8_basic_pages[text[i] & 0x7F], 0xFF);
         i++;
     }
 }
 
+void gfx_scroll_left(int x, int y, int w, int h, int dx)
+{
+    if (dx <= 0 || w <= 0 || h <= 0) return;
+    if (dx > w) dx = w;
+
+    // whole pages only, y and h are multiples of 8
+    for (int page = y / 8; page < (y + h) / 8; page++) {
+        char *row = page_byte(display_buffer, page, x);
+        memmove(row, row + dx, w - dx);
+        memset(row + w - dx, 0, dx);
+        mark_dirty(page, x, x + w);
+    }
+}
+
+#if CONFIG_BEER_DISPLAY_SH1106
+// command, parameter count, parameters. display on, contrast and mirroring
+// are the same as on the ssd1306 and stay with its panel driver
+static const uint8_t sh1106_init_cmds[] = {
+    0xAE, 0,                    // display off
+    0xD5, 1, 0x80,              // clock divider
+    0xA8, 1, GFX_HEIGHT - 1,    // multiplex ratio
+    0xD3, 1, 0x00,              // display offset
+    0x40, 0,                    // start line 0
+    0xAD, 1, 0x8B,              // dc-dc converter on, there is no 0x8d charge pump
+    0x32, 0,                    // pump voltage 8.0 V
+    0xDA, 1, 0x12,              // alternative com pins
+    0xD9, 1, 0x22,              // precharge
+    0xDB, 1, 0x35,              // vcom deselect level
+    0xA4, 0,                    // show the ram
+    0xA6, 0,                    // not inverted
+};
+
+// instead of esp_lcd_panel_init, the ssd1306 sequence sets an addressing mode
+// and a charge pump the sh1106 doesn't have
+esp_err_t gfx_sh1106_init(esp_lcd_panel_io_handle_t io)
+{
+    for (int i = 0; i < sizeof(sh1106_init_cmds); i += 2 + sh1106_init_cmds[i + 1]) {
+        int n = sh1106_init_cmds[i + 1];
+        esp_err_t err = esp_lcd_panel_io_tx_param(io, sh1106_init_cmds[i], n ? &sh1106_init_cmds[i + 2] : NULL, n);
+        if (err != ESP_OK) return err;
+    }
+    return ESP_OK;
+}
+
+// the sh1106 has no horizontal addressing mode, so a rectangle goes out
+// page by page, each from its own column address in the 132 column ram
+static void flush_rect(int p0, int p1, int x0, int x1)
+{
+    int w = x1 - x0;
+    int column = x0 + GFX_COLUMN_OFFSET;
+
+    for (int page = p0; page <= p1; page++) {
+        FRAME_LOCK();
+        memcpy(flush_buffer, page_byte(frame_buffer, page, x0), w);
+        FRAME_UNLOCK();
+
+        esp_lcd_panel_io_tx_param(gfx.io_handle, SH1106_CMD_PAGE | page, NULL, 0);
+        esp_lcd_panel_io_tx_param(gfx.io_handle, SH1106_CMD_COLUMN_LOW | (column & 0x0F), NULL, 0);
+        esp_lcd_panel_io_tx_param(gfx.io_handle, SH1106_CMD_COLUMN_HIGH | (column >> 4), NULL, 0);
+        esp_lcd_panel_io_tx_color(gfx.io_handle, -1, flush_buffer, w);
+#if CONFIG_BEER_DISPLAY_ASYNC_FLUSH
+        if (trans_done) xSemaphoreTake(trans_done, portMAX_DELAY);
+#endif
+        flush_stats.transfers++;
+    }
+    flush_stats.bytes_sent += w * (p1 - p0 + 1);
+}
+#else
+// send pages p0..p1 between columns x0 and x1 of the frame as one rectangle
+static void flush_rect(int p0, int p1, int x0, int x1)
+{
+    int w = x1 - x0;
+
+    // the panel expects the rectangle packed row by row
+    FRAME_LOCK();
+    for (int page = p0; page <= p1; page++) {
+        memcpy(&flush_buffer[(page - p0) * w], page_byte(frame_buffer, page, x0), w);
+    }
+    FRAME_UNLOCK();
+
+    esp_lcd_panel_draw_bitmap(gfx.panel_handle, x0, p0 * 8, x1, (p1 + 1) * 8, flush_buffer);
+#if CONFIG_BEER_DISPLAY_ASYNC_FLUSH
+    // flush_buffer may only be reused once the panel io is done with it
+    if (trans_done) xSemaphoreTake(trans_done, portMAX_DELAY);
+#endif
+    flush_stats.transfers++;
+    flush_stats.bytes_sent += w * (p1 - p0 + 1);
+}
+#endif
+
+// send everything submitted so far, in as few rectangles as pays off
+static void send_pending()
+{
+    struct gfx_span spans[GFX_PAGES];
+    FRAME_LOCK();
+    for (int page = 0; page < GFX_PAGES; page++) {
+        spans[page] = pending[page];
+        mark_clean(&pending[page]);
+    }
+    FRAME_UNLOCK();
+
+    int p0 = -1, p1 = -1, x0 = 0, x1 = 0, cost = 0;
+    for (int page = 0; page < GFX_PAGES; page++) {
+        if (spans[page].x0 >= spans[page].x1) continue;
+
+        int page_cost = spans[page].x1 - spans[page].x0 + GFX_FLUSH_OVERHEAD;
+        if (p0 >= 0 && GFX_MERGE_PAGES) {
+            // merge into the pending rectangle when one bigger transfer is
+            // cheaper than closing it and starting a new one for this page
+            int mx0 = spans[page].x0 < x0 ? spans[page].x0 : x0;
+            int mx1 = spans[page].x1 > x1 ? spans[page].x1 : x1;
+            int merged_cost = (mx1 - mx0) * (page - p0 + 1) + GFX_FLUSH_OVERHEAD;
+            if (merged_cost <= cost + page_cost) {
+                p1 = page;
+                x0 = mx0;
+                x1 = mx1;
+                cost = merged_cost;
+                continue;
+            }
+        }
+        if (p0 >= 0) {
+            flush_rect(p0, p1, x0, x1);
+        }
+        p0 = p1 = page;
+        x0 = spans[page].x0;
+        x1 = spans[page].x1;
+        cost = page_cost;
+    }
+    if (p0 >= 0) {
+        flush_rect(p0, p1, x0, x1);
+    }
+}
+
+// hand the frame over for sending, a frame that is still waiting is
+// overwritten, only the newest content of every span goes out
 void gfx_flush()
 {
-    esp_lcd_panel_draw_bitmap(gfx.panel_handle, 0, 0, gfx.width, gfx.height, display_buffer);
-}
\ No newline at end of file
+    bool superseded = false;
+    FRAME_LOCK();
+    for (int page = 0; page < GFX_PAGES; page++) {
+        if (pending[page].x0 < pending[page].x1) superseded = true;
+        if (dirty[page].x0 >= dirty[page].x1) continue;
+
+        int offset = page * GFX_WIDTH + dirty[page].x0;
+        memcpy(&frame_buffer[offset], &display_buffer[offset], dirty[page].x1 - dirty[page].x0);
+        if (dirty[page].x0 < pending[page].x0) pending[page].x0 = dirty[page].x0;
+        if (dirty[page].x1 > pending[page].x1) pending[page].x1 = dirty[page].x1;
+        mark_clean(&dirty[page]);
+    }
+    FRAME_UNLOCK();
+    flush_stats.flushes++;
+    if (superseded) flush_stats.superseded++;
+
+#if CONFIG_BEER_DISPLAY_ASYNC_FLUSH
+    if (flush_task) {
+        xTaskNotifyGive(flush_task);
+        return;
+    }
+#endif
+    send_pending();
+}
+
+#if CONFIG_BEER_DISPLAY_ASYNC_FLUSH
+static bool color_trans_done(esp_lcd_panel_io_handle_t io, esp_lcd_panel_io_event_data_t *edata, void *user_ctx)
+{
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(trans_done, &woken);
+    return woken == pdTRUE;
+}
+
+static void flush_task_fn(void *arg)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        send_pending();
+    }
+}
+
+// from now on gfx_flush only copies the frame, this task owns the bus
+TaskHandle_t gfx_start_flush_task(esp_lcd_panel_io_handle_t io, UBaseType_t priority)
+{
+    trans_done = xSemaphoreCreateBinaryStatic(&trans_done_buf);
+    esp_lcd_panel_io_callbacks_t cbs = {
+        .on_color_trans_done = color_trans_done,
+    };
+    if (esp_lcd_panel_io_register_event_callbacks(io, &cbs, NULL) != ESP_OK) {
+        vSemaphoreDelete(trans_done);
+        trans_done = NULL;
+    }
+    flush_task = xTaskCreateStatic(flush_task_fn, "gfx_flush", GFX_FLUSH_TASK_STACK, NULL, priority,
+                                   flush_task_stack, &flush_task_buf);
+    return flush_task;
+}
+#endif
+
+void gfx_get_flush_stats(struct gfx_flush_stats *stats)
+{
+    *stats = flush_stats;
+}
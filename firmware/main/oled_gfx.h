@@ -1,22 +1,67 @@
+#ifndef OLED_GFX_H
+#define OLED_GFX_H
 
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_vendor.h"
 #include "esp_lcd_panel_ops.h"
+#include "sdkconfig.h"
+#if CONFIG_BEER_DISPLAY_ASYNC_FLUSH
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
 
+// the panel geometry is fixed at build time, so every pixel address folds
+// into constants and shifts
+#define GFX_WIDTH           CONFIG_BEER_DISPLAY_WIDTH
+#define GFX_HEIGHT          CONFIG_BEER_DISPLAY_HEIGHT
+#define GFX_PAGES           (GFX_HEIGHT / 8)
+// first visible column in the controller ram, 2 on the 132 column sh1106
+#define GFX_COLUMN_OFFSET   CONFIG_BEER_DISPLAY_COLUMN_OFFSET
 
 struct oled_gfx
 {   
+    esp_lcd_panel_io_handle_t io_handle;
     esp_lcd_panel_handle_t panel_handle;
-    int width;
-    int height;
 };
 
+// how rectangle and line primitives combine with the framebuffer
+enum gfx_mode
+{
+    GFX_MODE_CLEAR,
+    GFX_MODE_SET,
+    GFX_MODE_XOR,
+};
+
+struct gfx_flush_stats
+{
+    uint32_t flushes;       // calls to gfx_flush
+    uint32_t transfers;     // draw_bitmap calls issued
+    uint32_t bytes_sent;    // framebuffer bytes pushed over i2c
+    uint32_t superseded;    // flushes that overwrote a frame not sent yet
+};
 
-void gfx_init(esp_lcd_panel_handle_t panel_handle, int width, int height);
+
+void gfx_init(esp_lcd_panel_io_handle_t io_handle, esp_lcd_panel_handle_t panel_handle);
 void gfx_draw_bitmap(int x, int y, int w, int h, const char *bitmap);
+void gfx_blit_columns(int x, int y, int w, const uint8_t *columns);
 void gfx_draw_text(int x, int y, const char *text);
 void gfx_clear_area(int x, int y, int w, int h);
 void gfx_fill_area(int x, int y, int w, int h);
+void gfx_invert_area(int x, int y, int w, int h);
+void gfx_fill_rect(int x, int y, int w, int h, enum gfx_mode mode);
+void gfx_draw_hline(int x, int y, int w, enum gfx_mode mode);
+void gfx_draw_vline(int x, int y, int h, enum gfx_mode mode);
+void gfx_scroll_left(int x, int y, int w, int h, int dx);
 void gfx_set_pixel(uint8_t x, uint8_t y);
 void gfx_flush();
-void gfx_clear_pixel(uint8_t x, uint8_t y);
\ No newline at end of file
+void gfx_clear_pixel(uint8_t x, uint8_t y);
+void gfx_mark_dirty(int x, int y, int w, int h);
+void gfx_get_flush_stats(struct gfx_flush_stats *stats);
+#if CONFIG_BEER_DISPLAY_SH1106
+esp_err_t gfx_sh1106_init(esp_lcd_panel_io_handle_t io);
+#endif
+#if CONFIG_BEER_DISPLAY_ASYNC_FLUSH
+TaskHandle_t gfx_start_flush_task(esp_lcd_panel_io_handle_t io, UBaseType_t priority);
+#endif
+
+#endif // OLED_GFX_H
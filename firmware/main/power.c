@@ -0,0 +1,144 @@
+#include "power.h"
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "esp_log.h"
+
+#define POWER_DIM_TIMEOUT_US   ((int64_t)CONFIG_BEER_DISPLAY_DIM_TIMEOUT * 1000000)
+#define POWER_OFF_TIMEOUT_US   ((int64_t)CONFIG_BEER_DISPLAY_OFF_TIMEOUT * 1000000)
+#define POWER_LOG_INTERVAL_US  (3600LL * 1000000)
+
+// ssd1306 contrast command, 0x7f is its reset value
+#define SSD1306_CMD_CONTRAST   0x81
+#define CONTRAST_ON            0x7F
+#define CONTRAST_DIM           CONFIG_BEER_DISPLAY_DIM_CONTRAST
+
+static const char *TAG = "POWER";
+static const char *state_names[POWER_DISPLAY_STATES] = {"on", "dim", "off"};
+
+// the sleep callback runs with interrupts off, everything else takes the lock
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static power_stats_t stats;
+
+static esp_lcd_panel_io_handle_t panel_io = NULL;
+static esp_lcd_panel_handle_t panel = NULL;
+static power_display_state_t display_state = POWER_DISPLAY_ON;
+static int64_t state_since_us;
+static int64_t last_activity_us;
+static int64_t last_log_us;
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+static esp_err_t IRAM_ATTR light_sleep_exit_cb(int64_t sleep_time_us, void *arg)
+{
+    stats.light_sleep_us += sleep_time_us;
+    stats.light_sleeps++;
+    return ESP_OK;
+}
+#endif
+
+esp_err_t power_init()
+{
+#if CONFIG_PM_ENABLE
+    // the radio needs a fixed cpu clock, the savings come from light sleep
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+#if CONFIG_BEER_POWER_SAVE
+        .light_sleep_enable = true,
+#endif
+    };
+    ESP_RETURN_ON_ERROR(esp_pm_configure(&pm_config), TAG, "pm configure failed");
+#endif
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs = {
+        .exit_cb = light_sleep_exit_cb,
+    };
+    ESP_RETURN_ON_ERROR(esp_pm_light_sleep_register_cbs(&cbs), TAG, "sleep callbacks failed");
+#else
+    ESP_LOGW(TAG, "PM_LIGHT_SLEEP_CALLBACKS is off, light sleep time is not counted");
+#endif
+    return ESP_OK;
+}
+
+static void set_contrast(uint8_t contrast)
+{
+    esp_lcd_panel_io_tx_param(panel_io, SSD1306_CMD_CONTRAST, &contrast, 1);
+}
+
+static void set_state(power_display_state_t state, int64_t now_us)
+{
+    if (state == display_state) return;
+
+    if (state == POWER_DISPLAY_OFF) {
+        esp_lcd_panel_disp_on_off(panel, false);
+    } else {
+        if (display_state == POWER_DISPLAY_OFF) esp_lcd_panel_disp_on_off(panel, true);
+        set_contrast(state == POWER_DISPLAY_DIM ? CONTRAST_DIM : CONTRAST_ON);
+    }
+    ESP_LOGD(TAG, "display %s", state_names[state]);
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.display_us[display_state] += now_us - state_since_us;
+    display_state = state;
+    state_since_us = now_us;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void power_display_init(esp_lcd_panel_io_handle_t io, esp_lcd_panel_handle_t panel_handle, int64_t now_us)
+{
+    panel_io = io;
+    panel = panel_handle;
+    display_state = POWER_DISPLAY_ON;
+    state_since_us = now_us;
+    last_activity_us = now_us;
+    last_log_us = now_us;
+    set_contrast(CONTRAST_ON);
+}
+
+bool power_display_wake(int64_t now_us)
+{
+    last_activity_us = now_us;
+    bool was_asleep = display_state != POWER_DISPLAY_ON;
+    set_state(POWER_DISPLAY_ON, now_us);
+    return was_asleep;
+}
+
+power_display_state_t power_update(bool heater_idle, int64_t now_us)
+{
+    // blank only while nothing is being heated, so a running heater always
+    // shows its status, at least dimmed
+    int64_t idle_us = now_us - last_activity_us;
+    power_display_state_t state = POWER_DISPLAY_ON;
+    if (POWER_OFF_TIMEOUT_US && idle_us >= POWER_OFF_TIMEOUT_US && heater_idle) {
+        state = POWER_DISPLAY_OFF;
+    } else if (POWER_DIM_TIMEOUT_US && idle_us >= POWER_DIM_TIMEOUT_US) {
+        state = POWER_DISPLAY_DIM;
+    }
+    set_state(state, now_us);
+
+    if (now_us - last_log_us >= POWER_LOG_INTERVAL_US) {
+        power_stats_t s;
+        power_get_stats(&s);
+        ESP_LOGI(TAG, "up %lds, light sleep %lds (%lu), display on %lds dim %lds off %lds",
+                 (long)(s.uptime_us / 1000000), (long)(s.light_sleep_us / 1000000), (unsigned long)s.light_sleeps,
+                 (long)(s.display_us[POWER_DISPLAY_ON] / 1000000), (long)(s.display_us[POWER_DISPLAY_DIM] / 1000000),
+                 (long)(s.display_us[POWER_DISPLAY_OFF] / 1000000));
+        last_log_us = now_us;
+    }
+    return display_state;
+}
+
+void power_get_stats(power_stats_t *out)
+{
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    out->display_us[display_state] += now_us - state_since_us;
+    portEXIT_CRITICAL(&stats_lock);
+    out->uptime_us = now_us;
+}
@@ -0,0 +1,39 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_ops.h"
+
+typedef enum {
+    POWER_DISPLAY_ON,
+    POWER_DISPLAY_DIM,
+    POWER_DISPLAY_OFF,
+    POWER_DISPLAY_STATES,
+} power_display_state_t;
+
+// time spent in every power state since boot
+typedef struct {
+    int64_t uptime_us;
+    int64_t light_sleep_us;     // cpu in automatic light sleep
+    uint32_t light_sleeps;
+    int64_t display_us[POWER_DISPLAY_STATES];
+} power_stats_t;
+
+// enable dynamic power management, light sleep when BEER_POWER_SAVE is set
+esp_err_t power_init();
+
+// the display starts fully on, it is only touched from the display task
+void power_display_init(esp_lcd_panel_io_handle_t io, esp_lcd_panel_handle_t panel, int64_t now_us);
+
+// user activity, returns true when the display was dimmed or blank
+bool power_display_wake(int64_t now_us);
+
+// dim and blank the display after inactivity, returns the new state
+power_display_state_t power_update(bool heater_idle, int64_t now_us);
+
+void power_get_stats(power_stats_t *stats);
+
+#endif // POWER_H
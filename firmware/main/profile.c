@@ -0,0 +1,127 @@
+#include "profile.h"
+#include "string.h"
+
+// log-linear histogram: four buckets per power of two, exact below 4 us,
+// everything from about 1.8 s up lands in the last bucket
+#define PROFILE_SUB_BUCKETS 4
+#define PROFILE_BUCKETS     80
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t hist[PROFILE_BUCKETS];
+} profile_stage_stats_t;
+
+static const char *stage_names[PROFILE_STAGES] = {
+    "sensor", "control", "render", "flush", "report", "jitter",
+};
+
+// recording is a handful of instructions, readers take the lock for a copy
+static portMUX_TYPE profile_lock = portMUX_INITIALIZER_UNLOCKED;
+static profile_stage_stats_t stages[PROFILE_STAGES];
+static int64_t last_loop_us = -1;
+
+static TaskHandle_t tasks[PROFILE_MAX_TASKS];
+static int task_count = 0;
+
+static int bucket_of(uint32_t us)
+{
+    if (us < PROFILE_SUB_BUCKETS) return us;
+    int octave = 31 - __builtin_clz(us);
+    int bucket = (octave - 1) * PROFILE_SUB_BUCKETS + ((us >> (octave - 2)) & (PROFILE_SUB_BUCKETS - 1));
+    return bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1;
+}
+
+// smallest value that falls in the bucket after this one
+static uint32_t bucket_end(int bucket)
+{
+    bucket++;
+    if (bucket < PROFILE_SUB_BUCKETS) return bucket;
+    int octave = bucket / PROFILE_SUB_BUCKETS + 1;
+    return (uint32_t)(PROFILE_SUB_BUCKETS + bucket % PROFILE_SUB_BUCKETS) << (octave - 2);
+}
+
+void profile_record(profile_stage_t stage, uint32_t us)
+{
+    profile_stage_stats_t *s = &stages[stage];
+    portENTER_CRITICAL(&profile_lock);
+    if (s->count == 0 || us < s->min_us) s->min_us = us;
+    if (us > s->max_us) s->max_us = us;
+    s->sum_us += us;
+    s->count++;
+    s->hist[bucket_of(us)]++;
+    portEXIT_CRITICAL(&profile_lock);
+}
+
+void profile_end(profile_stage_t stage, int64_t start_us)
+{
+    profile_record(stage, esp_timer_get_time() - start_us);
+}
+
+// call once per loop iteration, records how far it is off the nominal period
+void profile_loop(int64_t now_us, int64_t period_us)
+{
+    if (last_loop_us >= 0) {
+        int64_t jitter = now_us - last_loop_us - period_us;
+        profile_record(PROFILE_JITTER, jitter < 0 ? -jitter : jitter);
+    }
+    last_loop_us = now_us;
+}
+
+void profile_get(profile_stage_t stage, profile_summary_t *summary)
+{
+    profile_stage_stats_t s;
+    portENTER_CRITICAL(&profile_lock);
+    s = stages[stage];
+    portEXIT_CRITICAL(&profile_lock);
+
+    *summary = (profile_summary_t){
+        .count = s.count,
+        .min_us = s.min_us,
+        .avg_us = s.count ? s.sum_us / s.count : 0,
+        .max_us = s.max_us,
+    };
+
+    // the bucket holding the 99th percentile sample
+    uint32_t rank = s.count - s.count / 100, seen = 0;
+    for (int i = 0; i < PROFILE_BUCKETS && s.count; i++) {
+        seen += s.hist[i];
+        if (seen >= rank) {
+            uint32_t end = bucket_end(i) - 1;
+            summary->p99_us = end < s.max_us ? end : s.max_us;
+            break;
+        }
+    }
+}
+
+const char *profile_stage_name(profile_stage_t stage)
+{
+    return stage < PROFILE_STAGES ? stage_names[stage] : "?";
+}
+
+void profile_reset()
+{
+    portENTER_CRITICAL(&profile_lock);
+    memset(stages, 0, sizeof(stages));
+    portEXIT_CRITICAL(&profile_lock);
+}
+
+void profile_register_task(TaskHandle_t task)
+{
+    // tasks register from more than one task during boot
+    portENTER_CRITICAL(&profile_lock);
+    if (task && task_count < PROFILE_MAX_TASKS) tasks[task_count++] = task;
+    portEXIT_CRITICAL(&profile_lock);
+}
+
+int profile_task_count()
+{
+    return task_count;
+}
+
+TaskHandle_t profile_get_task(int index)
+{
+    return index < task_count ? tasks[index] : NULL;
+}
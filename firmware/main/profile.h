@@ -0,0 +1,47 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#define PROFILE_MAX_TASKS 8
+
+// the hot path stages, each one is only recorded by a single task
+typedef enum {
+    PROFILE_SENSOR,     // reading the scratchpads after a conversion
+    PROFILE_CONTROL,    // fusion, controller and heater update
+    PROFILE_RENDER,     // drawing a sample into the framebuffer
+    PROFILE_FLUSH,      // handing the dirty spans to the panel
+    PROFILE_REPORT,     // deciding on and sending zigbee reports
+    PROFILE_JITTER,     // deviation of the control loop from the sample period
+    PROFILE_STAGES,
+} profile_stage_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t avg_us;
+    uint32_t max_us;
+    uint32_t p99_us;    // upper bound of the histogram bucket, within 25 %
+} profile_summary_t;
+
+static inline int64_t profile_start()
+{
+    return esp_timer_get_time();
+}
+
+void profile_record(profile_stage_t stage, uint32_t us);
+void profile_end(profile_stage_t stage, int64_t start_us);
+void profile_loop(int64_t now_us, int64_t period_us);
+void profile_get(profile_stage_t stage, profile_summary_t *summary);
+const char *profile_stage_name(profile_stage_t stage);
+void profile_reset();
+
+// tasks whose stack high-water mark is tracked
+void profile_register_task(TaskHandle_t task);
+int profile_task_count();
+TaskHandle_t profile_get_task(int index);
+
+#endif // PROFILE_H
@@ -0,0 +1,199 @@
+#include "sensor_fusion.h"
+#include "string.h"
+#include "stdlib.h"
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+#define FUSION_OUTLIER_DELTA CONFIG_BEER_FUSION_OUTLIER_DELTA
+#define FUSION_STUCK_SAMPLES CONFIG_BEER_FUSION_STUCK_SAMPLES
+// how far the other probes have to move before an unchanged probe counts as stuck
+#define FUSION_STUCK_DELTA   50
+
+static const char *TAG = "FUSION";
+
+static sensor_channel_t channels[EXAMPLE_ONEWIRE_MAX_DS18B20];
+static int16_t stuck_ref[EXAMPLE_ONEWIRE_MAX_DS18B20];
+// each probe's reading when the probes last agreed
+static int16_t agree_ref[EXAMPLE_ONEWIRE_MAX_DS18B20];
+static fusion_mode_t fusion_mode;
+static int16_t last_fused = TEMP_INVALID;
+static int ambient_sensor = -1;
+
+static int16_t median(int16_t *values, int n)
+{
+    // insertion sort, n is at most SENSOR_HISTORY_LEN
+    for(int i = 1; i < n; i++){
+        int16_t v = values[i];
+        int j = i - 1;
+        while(j >= 0 && values[j] > v){
+            values[j + 1] = values[j];
+            j--;
+        }
+        values[j + 1] = v;
+    }
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+static int16_t history_median(const sensor_channel_t *ch)
+{
+    int16_t values[SENSOR_HISTORY_LEN];
+    memcpy(values, ch->history, ch->len * sizeof(int16_t));
+    return median(values, ch->len);
+}
+
+static void history_push(sensor_channel_t *ch, int16_t value)
+{
+    ch->history[ch->head] = value;
+    ch->head = (ch->head + 1) % SENSOR_HISTORY_LEN;
+    if(ch->len < SENSOR_HISTORY_LEN) ch->len++;
+}
+
+void fusion_init()
+{
+    memset(channels, 0, sizeof(channels));
+    for(int i = 0; i < EXAMPLE_ONEWIRE_MAX_DS18B20; i++){
+        channels[i].weight = 1;
+        stuck_ref[i] = TEMP_INVALID;
+        agree_ref[i] = TEMP_INVALID;
+    }
+#if CONFIG_BEER_FUSION_WEIGHTED_MEAN
+    fusion_mode = FUSION_WEIGHTED_MEAN;
+#elif CONFIG_BEER_FUSION_MAX
+    fusion_mode = FUSION_MAX;
+#else
+    fusion_mode = FUSION_MEDIAN;
+#endif
+    fusion_set_ambient(CONFIG_BEER_AMBIENT_PROBE);
+}
+
+void fusion_set_mode(fusion_mode_t mode)
+{
+    fusion_mode = mode;
+}
+
+void fusion_set_weight(int sensor, uint8_t weight)
+{
+    if(sensor < 0 || sensor >= EXAMPLE_ONEWIRE_MAX_DS18B20) return;
+    channels[sensor].weight = weight;
+}
+
+// the ambient probe measures the air around the fermenter, it is left out
+// of the fused temperature. -1 for none
+void fusion_set_ambient(int sensor)
+{
+    ambient_sensor = sensor >= 0 && sensor < EXAMPLE_ONEWIRE_MAX_DS18B20 ? sensor : -1;
+}
+
+// median of the ambient probe's recent readings, TEMP_INVALID without one
+int16_t fusion_get_ambient()
+{
+    if(ambient_sensor < 0) return TEMP_INVALID;
+    const sensor_channel_t *ch = &channels[ambient_sensor];
+    if(!ch->valid || ch->len == 0) return TEMP_INVALID;
+    return history_median(ch);
+}
+
+const sensor_channel_t *fusion_get_channel(int sensor)
+{
+    if(sensor < 0 || sensor >= EXAMPLE_ONEWIRE_MAX_DS18B20) return NULL;
+    return &channels[sensor];
+}
+
+bool fusion_update(const temp_sample_t *sample, int16_t *fused)
+{
+    int16_t values[EXAMPLE_ONEWIRE_MAX_DS18B20];
+    int n = 0;
+
+    for(int i = 0; i < sample->count; i++){
+        sensor_channel_t *ch = &channels[i];
+        ch->valid = sample->valid_mask & (1 << i);
+        if(!ch->valid) continue;
+
+        int16_t v = sample->temps[i];
+
+        // reject spikes against the probe's own recent readings, a real
+        // step change is accepted once it fills half of the history
+        ch->outlier = ch->len >= 3 && abs(v - history_median(ch)) > FUSION_OUTLIER_DELTA;
+        history_push(ch, v);
+
+        // an unchanged reading is only suspicious while the others move
+        if(v == ch->last){
+            if(ch->unchanged < UINT16_MAX) ch->unchanged++;
+        } else {
+            ch->unchanged = 0;
+            stuck_ref[i] = last_fused;
+        }
+        // the air doesn't have to follow the beer
+        ch->stuck = ch->unchanged >= FUSION_STUCK_SAMPLES && stuck_ref[i] != TEMP_INVALID &&
+                    abs(last_fused - stuck_ref[i]) > FUSION_STUCK_DELTA && i != ambient_sensor;
+        ch->last = v;
+
+        if(!ch->outlier && i != ambient_sensor) values[n++] = v;
+    }
+
+    // with three or more probes a majority can outvote a drifting one
+    int pair[2], pairs = 0;
+    if(n >= 3){
+        int16_t m = median(values, n);
+        for(int i = 0; i < sample->count; i++){
+            sensor_channel_t *ch = &channels[i];
+            if(!ch->valid || ch->outlier || i == ambient_sensor) continue;
+            if(abs(ch->last - m) > FUSION_OUTLIER_DELTA) ch->outlier = true;
+        }
+    } else {
+        for(int i = 0; i < sample->count; i++){
+            const sensor_channel_t *ch = &channels[i];
+            if(ch->valid && !ch->outlier && !ch->stuck && i != ambient_sensor && pairs < 2) pair[pairs++] = i;
+        }
+    }
+    // two probes that disagree are told apart by how far each moved since
+    // they last agreed, the beer moves both alike
+    if(pairs == 2){
+        sensor_channel_t *a = &channels[pair[0]], *b = &channels[pair[1]];
+        if(abs(a->last - b->last) <= FUSION_OUTLIER_DELTA){
+            agree_ref[pair[0]] = a->last;
+            agree_ref[pair[1]] = b->last;
+        } else if(agree_ref[pair[0]] != TEMP_INVALID && agree_ref[pair[1]] != TEMP_INVALID){
+            int moved_a = abs(a->last - agree_ref[pair[0]]);
+            int moved_b = abs(b->last - agree_ref[pair[1]]);
+            if(moved_a != moved_b) (moved_a > moved_b ? a : b)->outlier = true;
+        }
+    }
+
+    int32_t sum = 0, weights = 0;
+    int16_t max = INT16_MIN;
+    n = 0;
+    for(int i = 0; i < sample->count; i++){
+        sensor_channel_t *ch = &channels[i];
+        if(i == ambient_sensor){
+            if(ch->outlier) ch->valid = false;
+            continue;
+        }
+        if(!ch->valid || ch->outlier || ch->stuck){
+            if(ch->valid) ESP_LOGD(TAG, "ignoring DS18B20[%d] (%s)", i, ch->outlier ? "outlier" : "stuck");
+            ch->valid = false;
+            continue;
+        }
+        values[n++] = ch->last;
+        sum += ch->last * ch->weight;
+        weights += ch->weight;
+        if(ch->last > max) max = ch->last;
+    }
+    if(n == 0) return false;
+
+    switch(fusion_mode){
+    case FUSION_WEIGHTED_MEAN:
+        *fused = weights > 0 ? sum / weights : median(values, n);
+        break;
+    case FUSION_MAX:
+        *fused = max;
+        break;
+    case FUSION_MEDIAN:
+    default:
+        *fused = median(values, n);
+        break;
+    }
+    last_fused = *fused;
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef SENSOR_FUSION_H
+#define SENSOR_FUSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "temp_sensor.h"
+
+#define SENSOR_HISTORY_LEN 8
+
+typedef enum {
+    FUSION_MEDIAN,
+    FUSION_WEIGHTED_MEAN,
+    FUSION_MAX,
+} fusion_mode_t;
+
+// per-sensor sample stream and health state
+typedef struct {
+    int16_t history[SENSOR_HISTORY_LEN];
+    uint8_t head;
+    uint8_t len;
+    uint8_t weight;
+    int16_t last;
+    uint16_t unchanged;     // consecutive samples with an identical reading
+    bool valid;             // last sample was read and used for fusion
+    bool outlier;
+    bool stuck;
+} sensor_channel_t;
+
+void fusion_init();
+void fusion_set_mode(fusion_mode_t mode);
+void fusion_set_weight(int sensor, uint8_t weight);
+void fusion_set_ambient(int sensor);
+int16_t fusion_get_ambient();
+bool fusion_update(const temp_sample_t *sample, int16_t *fused);
+const sensor_channel_t *fusion_get_channel(int sensor);
+
+#endif // SENSOR_FUSION_H
@@ -0,0 +1,47 @@
+#include "spsc_ring.h"
+#include "string.h"
+#include "assert.h"
+
+void spsc_ring_init(spsc_ring_t *ring, void *buffer, uint16_t item_size, uint16_t capacity)
+{
+    assert(capacity && (capacity & (capacity - 1)) == 0);
+    ring->buffer = buffer;
+    ring->item_size = item_size;
+    ring->capacity = capacity;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+}
+
+// the indices run freely and wrap at 2^32, head - tail is the fill level
+bool spsc_ring_push(spsc_ring_t *ring, const void *item)
+{
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == ring->capacity) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    memcpy(&ring->buffer[(head & (ring->capacity - 1)) * ring->item_size], item, ring->item_size);
+    // publish the item before the new head becomes visible to the consumer
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool spsc_ring_pop(spsc_ring_t *ring, void *item)
+{
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail) return false;
+
+    memcpy(item, &ring->buffer[(tail & (ring->capacity - 1)) * ring->item_size], ring->item_size);
+    // hand the slot back only after it has been copied out
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+uint32_t spsc_ring_dropped(spsc_ring_t *ring)
+{
+    return atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+}
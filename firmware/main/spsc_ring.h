@@ -0,0 +1,24 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// lock-free ring for exactly one producer task and one consumer task,
+// items are copied in and out by value
+typedef struct {
+    uint8_t *buffer;
+    uint16_t item_size;
+    uint16_t capacity;      // power of two
+    atomic_uint head;       // next slot to write, only the producer stores it
+    atomic_uint tail;       // next slot to read, only the consumer stores it
+    atomic_uint dropped;    // pushes that found the ring full
+} spsc_ring_t;
+
+void spsc_ring_init(spsc_ring_t *ring, void *buffer, uint16_t item_size, uint16_t capacity);
+bool spsc_ring_push(spsc_ring_t *ring, const void *item);
+bool spsc_ring_pop(spsc_ring_t *ring, void *item);
+uint32_t spsc_ring_dropped(spsc_ring_t *ring);
+
+#endif // SPSC_RING_H
@@ -0,0 +1,339 @@
+#include "telemetry.h"
+#include "string.h"
+#include "stddef.h"
+
+#include "sdkconfig.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_check.h"
+#include "esp_log.h"
+
+#define TELEMETRY_PARTITION_SUBTYPE 0x40
+#define TELEMETRY_INTERVAL_S        CONFIG_BEER_TELEMETRY_INTERVAL
+
+// samples are batched in RAM and written one 256 byte flash page at a time,
+// the partition is used as a ring of pages erased a sector ahead of the writer
+#define TELEMETRY_BLOCK_SIZE        256
+#define TELEMETRY_SECTOR_SIZE       4096
+#define TELEMETRY_BLOCKS_PER_SECTOR (TELEMETRY_SECTOR_SIZE / TELEMETRY_BLOCK_SIZE)
+#define TELEMETRY_MAGIC             0x4254
+#define TELEMETRY_VERSION           1
+
+// block layout, decoded by tools/telemetry_decode.py as '<HBBIIIHhBBI'
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t count;          // samples in this block, the first one is in the header
+    uint32_t seq;           // block number, consecutive blocks differ by one
+    uint32_t first_sample;  // sample number of the first sample
+    uint32_t time_s;        // uptime of the first sample
+    uint16_t boot;
+    int16_t base_temp;      // temperature of the first sample
+    uint8_t heater;         // heater state of the first sample
+    uint8_t payload_len;
+    uint32_t crc;           // crc32 of the header up to here and the payload
+} telemetry_header_t;
+
+// every further sample is varint(dt) varint(zigzag(dtemp) << 1 | heater)
+#define TELEMETRY_PAYLOAD_MAX (TELEMETRY_BLOCK_SIZE - sizeof(telemetry_header_t))
+#define TELEMETRY_RECORD_MAX  10
+
+static const char *TAG = "TELEMETRY";
+
+static const esp_partition_t *partition = NULL;
+static uint32_t block_total;
+static uint32_t next_block;         // index the next full block is written to
+static uint32_t next_seq;
+static int32_t newest_block = -1;   // most recent block on flash, -1 when empty
+static int32_t oldest_block = -1;   // start of the chain of consecutive blocks
+static uint32_t oldest_seq;         // first sample of oldest_block
+static uint16_t boot;
+static uint32_t sample_seq;         // number of the next sample logged
+static uint32_t flushed_seq;        // samples that made it to flash
+
+static uint8_t block[TELEMETRY_BLOCK_SIZE];
+static telemetry_header_t *const pending = (telemetry_header_t*)block;
+static int16_t prev_temp;
+static uint32_t prev_time;
+static bool logging = false;
+
+static int put_varint(uint8_t *buf, uint32_t value)
+{
+    int n = 0;
+    while (value >= 0x80) {
+        buf[n++] = value | 0x80;
+        value >>= 7;
+    }
+    buf[n++] = value;
+    return n;
+}
+
+static int get_varint(const uint8_t *buf, int len, uint32_t *value)
+{
+    *value = 0;
+    for (int n = 0; n < len && n < 5; n++) {
+        *value |= (uint32_t)(buf[n] & 0x7F) << (7 * n);
+        if (!(buf[n] & 0x80)) return n + 1;
+    }
+    return -1;
+}
+
+static uint32_t block_crc(const uint8_t *data)
+{
+    const telemetry_header_t *hdr = (const telemetry_header_t*)data;
+    uint32_t crc = esp_rom_crc32_le(0, data, offsetof(telemetry_header_t, crc));
+    return esp_rom_crc32_le(crc, data + sizeof(telemetry_header_t), hdr->payload_len);
+}
+
+static bool read_header(uint32_t index, telemetry_header_t *hdr)
+{
+    if (esp_partition_read(partition, index * TELEMETRY_BLOCK_SIZE, hdr, sizeof(*hdr)) != ESP_OK) return false;
+    return hdr->magic == TELEMETRY_MAGIC && hdr->version == TELEMETRY_VERSION &&
+           hdr->count > 0 && hdr->payload_len <= TELEMETRY_PAYLOAD_MAX;
+}
+
+static bool block_erased(uint32_t index)
+{
+    uint32_t words[TELEMETRY_BLOCK_SIZE / 4];
+    if (esp_partition_read(partition, index * TELEMETRY_BLOCK_SIZE, words, sizeof(words)) != ESP_OK) return false;
+    for (int i = 0; i < TELEMETRY_BLOCK_SIZE / 4; i++) {
+        if (words[i] != 0xFFFFFFFF) return false;
+    }
+    return true;
+}
+
+static void write_block()
+{
+    // entering a new sector: erase it, dropping the oldest 16 blocks
+    if (next_block % TELEMETRY_BLOCKS_PER_SECTOR == 0) {
+        esp_err_t err = esp_partition_erase_range(partition, next_block * TELEMETRY_BLOCK_SIZE, TELEMETRY_SECTOR_SIZE);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "erase failed: %s", esp_err_to_name(err));
+            return;
+        }
+        // the log wrapped, it now starts after the erased sector
+        if (oldest_block >= 0 && oldest_block / TELEMETRY_BLOCKS_PER_SECTOR == next_block / TELEMETRY_BLOCKS_PER_SECTOR) {
+            telemetry_header_t hdr;
+            uint32_t index = (next_block / TELEMETRY_BLOCKS_PER_SECTOR + 1) * TELEMETRY_BLOCKS_PER_SECTOR % block_total;
+            oldest_block = -1;
+            if (read_header(index, &hdr)) {
+                oldest_block = index;
+                oldest_seq = hdr.first_sample;
+            }
+        }
+    }
+
+    pending->crc = block_crc(block);
+    esp_err_t err = esp_partition_write(partition, next_block * TELEMETRY_BLOCK_SIZE, block, TELEMETRY_BLOCK_SIZE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "write failed: %s", esp_err_to_name(err));
+    } else {
+        if (oldest_block < 0) {
+            oldest_block = next_block;
+            oldest_seq = pending->first_sample;
+        }
+        newest_block = next_block;
+        flushed_seq = pending->first_sample + pending->count;
+    }
+    next_block = (next_block + 1) % block_total;
+    next_seq++;
+}
+
+static void start_block(int16_t temp, bool heater, uint32_t now_s)
+{
+    memset(block, 0xFF, sizeof(block));
+    *pending = (telemetry_header_t){
+        .magic = TELEMETRY_MAGIC,
+        .version = TELEMETRY_VERSION,
+        .count = 1,
+        .seq = next_seq,
+        .first_sample = sample_seq,
+        .time_s = now_s,
+        .boot = boot,
+        .base_temp = temp,
+        .heater = heater,
+        .payload_len = 0,
+    };
+}
+
+esp_err_t telemetry_init()
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, TELEMETRY_PARTITION_SUBTYPE, "telemetry");
+    ESP_RETURN_ON_FALSE(partition, ESP_ERR_NOT_FOUND, TAG, "no telemetry partition");
+    block_total = partition->size / TELEMETRY_BLOCK_SIZE;
+
+    // the newest block is the valid one with the highest sequence number
+    telemetry_header_t hdr, newest;
+    for (uint32_t i = 0; i < block_total; i++) {
+        if (!read_header(i, &hdr)) continue;
+        if (newest_block < 0 || hdr.seq > newest.seq) {
+            newest = hdr;
+            newest_block = i;
+        }
+    }
+
+    if (newest_block >= 0) {
+        next_block = (newest_block + 1) % block_total;
+        next_seq = newest.seq + 1;
+        boot = newest.boot + 1;
+        sample_seq = newest.first_sample + newest.count;
+        flushed_seq = sample_seq;
+
+        // follow the sequence numbers back to where the chain starts
+        uint32_t index = newest_block;
+        oldest_block = newest_block;
+        oldest_seq = newest.first_sample;
+        for (uint32_t seq = newest.seq; ; ) {
+            index = (index + block_total - 1) % block_total;
+            if (index == newest_block || !read_header(index, &hdr) || hdr.seq != --seq) break;
+            oldest_block = index;
+            oldest_seq = hdr.first_sample;
+        }
+    }
+
+    // a block interrupted by power loss can't be programmed again, skip to
+    // the next sector which gets erased on the first write
+    if (next_block % TELEMETRY_BLOCKS_PER_SECTOR && !block_erased(next_block)) {
+        next_block = (next_block / TELEMETRY_BLOCKS_PER_SECTOR + 1) * TELEMETRY_BLOCKS_PER_SECTOR % block_total;
+    }
+
+    ESP_LOGI(TAG, "boot %u, %lu samples logged, next block %lu", boot, (unsigned long)sample_seq, (unsigned long)next_block);
+    return ESP_OK;
+}
+
+void telemetry_log(int16_t temp, bool heater, uint32_t now_s)
+{
+    if (!partition) return;
+    if (logging && now_s - prev_time < TELEMETRY_INTERVAL_S) return;
+
+    if (!logging) {
+        start_block(temp, heater, now_s);
+        logging = true;
+    } else {
+        uint8_t record[TELEMETRY_RECORD_MAX];
+        int32_t delta = temp - prev_temp;
+        uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+        int n = put_varint(record, now_s - prev_time);
+        n += put_varint(&record[n], zigzag << 1 | heater);
+
+        if (pending->payload_len + n > TELEMETRY_PAYLOAD_MAX || pending->count == UINT8_MAX) {
+            write_block();
+            start_block(temp, heater, now_s);
+        } else {
+            memcpy(&block[sizeof(telemetry_header_t) + pending->payload_len], record, n);
+            pending->payload_len += n;
+            pending->count++;
+        }
+    }
+
+    prev_temp = temp;
+    prev_time = now_s;
+    sample_seq++;
+}
+
+// decode one block, records numbered below first_seq are skipped
+static bool decode_block(uint32_t index, uint32_t first_seq, telemetry_record_cb_t cb, void *ctx)
+{
+    uint8_t data[TELEMETRY_BLOCK_SIZE];
+    const telemetry_header_t *hdr = (const telemetry_header_t*)data;
+    if (esp_partition_read(partition, index * TELEMETRY_BLOCK_SIZE, data, sizeof(data)) != ESP_OK) return false;
+    if (hdr->payload_len > TELEMETRY_PAYLOAD_MAX || hdr->crc != block_crc(data)) {
+        ESP_LOGW(TAG, "block %lu is corrupt", (unsigned long)index);
+        return false;
+    }
+
+    telemetry_record_t rec = {
+        .seq = hdr->first_sample,
+        .boot = hdr->boot,
+        .time_s = hdr->time_s,
+        .temp = hdr->base_temp,
+        .heater = hdr->heater,
+    };
+    const uint8_t *payload = data + sizeof(telemetry_header_t);
+    int pos = 0;
+
+    for (int i = 0; i < hdr->count; i++) {
+        if (i > 0) {
+            uint32_t dt, value;
+            int n = get_varint(&payload[pos], hdr->payload_len - pos, &dt);
+            if (n < 0) return false;
+            pos += n;
+            n = get_varint(&payload[pos], hdr->payload_len - pos, &value);
+            if (n < 0) return false;
+            pos += n;
+
+            uint32_t zigzag = value >> 1;
+            rec.seq++;
+            rec.time_s += dt;
+            rec.temp += (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+            rec.heater = value & 1;
+        }
+        if (rec.seq >= first_seq) cb(&rec, ctx);
+    }
+    return true;
+}
+
+// replay up to max_samples of the most recent logged samples, oldest first
+int telemetry_recover(uint32_t max_samples, telemetry_record_cb_t cb, void *ctx)
+{
+    if (!partition || newest_block < 0) return 0;
+
+    // walk back over consecutive blocks until enough samples are covered
+    telemetry_header_t hdr;
+    uint32_t index = newest_block, oldest = newest_block, covered = 0;
+    uint32_t seq;
+    if (!read_header(index, &hdr)) return 0;
+    seq = hdr.seq;
+    while (covered < max_samples) {
+        covered += hdr.count;
+        oldest = index;
+        index = (index + block_total - 1) % block_total;
+        if (index == newest_block || !read_header(index, &hdr) || hdr.seq != --seq) break;
+    }
+
+    uint32_t first_seq = flushed_seq > max_samples ? flushed_seq - max_samples : 0;
+    int blocks = 0;
+    for (index = oldest; ; index = (index + 1) % block_total) {
+        if (decode_block(index, first_seq, cb, ctx)) blocks++;
+        if (index == newest_block) break;
+    }
+
+    ESP_LOGI(TAG, "recovered samples from #%lu out of %d blocks", (unsigned long)first_seq, blocks);
+    return blocks;
+}
+
+// read from other tasks, a block the writer is just replacing fails its crc
+void telemetry_get_range(telemetry_range_t *range)
+{
+    range->next_seq = flushed_seq;
+    range->oldest_seq = oldest_block >= 0 ? oldest_seq : flushed_seq;
+    range->boot = boot;
+}
+
+// the block holding sample seq, the oldest block for a sample that is
+// overwritten already, -1 when seq isn't on flash yet
+int32_t telemetry_find_block(uint32_t seq)
+{
+    if (!partition || newest_block < 0 || seq >= flushed_seq) return -1;
+    if (seq <= oldest_seq) return oldest_block;
+
+    telemetry_header_t hdr;
+    uint32_t index = newest_block;
+    while (read_header(index, &hdr) && hdr.first_sample > seq && index != oldest_block) {
+        index = (index + block_total - 1) % block_total;
+    }
+    return index;
+}
+
+// decode one block from sample first_seq on, returns the next block of the
+// chain or -1 after the newest one
+int32_t telemetry_read_block(int32_t index, uint32_t first_seq, telemetry_record_cb_t cb, void *ctx)
+{
+    telemetry_header_t hdr, next;
+    if (!partition || index < 0 || !read_header(index, &hdr)) return -1;
+    decode_block(index, first_seq, cb, ctx);
+    if (index == newest_block) return -1;
+
+    uint32_t next_index = (index + 1) % block_total;
+    return read_header(next_index, &next) && next.seq == hdr.seq + 1 ? next_index : -1;
+}
@@ -0,0 +1,36 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// one logged sample as it comes back out of the flash log
+typedef struct {
+    uint32_t seq;       // sample number, keeps counting across reboots
+    uint16_t boot;      // boot counter of the run that logged it
+    uint32_t time_s;    // uptime of that run in seconds
+    int16_t temp;       // centi-degrees
+    bool heater;
+} telemetry_record_t;
+
+typedef void (*telemetry_record_cb_t)(const telemetry_record_t *record, void *ctx);
+
+// samples on flash, those still batched in RAM are not readable yet
+typedef struct {
+    uint32_t oldest_seq;    // first sample not overwritten yet
+    uint32_t next_seq;      // first sample not on flash yet
+    uint16_t boot;          // boot counter of the current run
+} telemetry_range_t;
+
+esp_err_t telemetry_init();
+void telemetry_log(int16_t temp, bool heater, uint32_t now_s);
+int telemetry_recover(uint32_t max_samples, telemetry_record_cb_t cb, void *ctx);
+void telemetry_get_range(telemetry_range_t *range);
+
+// resumable reading from any sample on: find the block holding seq, then
+// hand every block to telemetry_read_block along with the next sample wanted
+int32_t telemetry_find_block(uint32_t seq);
+int32_t telemetry_read_block(int32_t index, uint32_t first_seq, telemetry_record_cb_t cb, void *ctx);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,180 @@
+#include "temp_graph.h"
+#include "oled_gfx.h"
+
+#include "esp_log.h"
+
+// headroom above and below the data when the scale is recomputed, in 0.01 C
+#define GRAPH_MARGIN     50
+// extra slack tolerated before the scale is tightened again
+#define GRAPH_HYSTERESIS 100
+
+static const char *TAG = "GRAPH";
+
+static uint32_t sample_count = 0;   // raw samples pushed through the window
+
+// monotonic deques of sample numbers, the front holds the window min/max
+static uint32_t min_deque[GRAPH_W];
+static uint32_t max_deque[GRAPH_W];
+static uint32_t min_head, min_tail, max_head, max_tail;
+
+static int16_t scale_lo, scale_hi;
+static int last_y = -1;
+static int zoom = GRAPH_ZOOM_RAW;
+static bool rescale = true;
+
+static const char *zoom_labels[GRAPH_ZOOM_LEVELS] = {"   ", " 1m", "10m", " 1h"};
+
+// the samples themselves live in the raw tier of the history store
+#define SAMPLE(n) history_raw_at(n)
+
+static void window_push(uint32_t n)
+{
+    int16_t temp = SAMPLE(n);
+    sample_count = n + 1;
+
+    while (min_tail != min_head && SAMPLE(min_deque[(min_tail - 1) % GRAPH_W]) >= temp) min_tail--;
+    min_deque[min_tail++ % GRAPH_W] = n;
+    while (max_tail != max_head && SAMPLE(max_deque[(max_tail - 1) % GRAPH_W]) <= temp) max_tail--;
+    max_deque[max_tail++ % GRAPH_W] = n;
+
+    // drop sample numbers that scrolled out of the window
+    if (n >= GRAPH_W) {
+        if (min_deque[min_head % GRAPH_W] <= n - GRAPH_W) min_head++;
+        if (max_deque[max_head % GRAPH_W] <= n - GRAPH_W) max_head++;
+    }
+}
+
+static int to_y(int16_t temp)
+{
+    int y = (temp - scale_lo) * (GRAPH_H - 1) / (scale_hi - scale_lo);
+    if (y < 0) y = 0;
+    if (y > GRAPH_H - 1) y = GRAPH_H - 1;
+    return y;
+}
+
+// connect the previous column's value to this one with a vertical line
+static void draw_column(int x, int y, int prev_y)
+{
+    int top = GRAPH_Y + GRAPH_H - 1 - y;
+    if (prev_y < 0 || prev_y == y) {
+        gfx_set_pixel(x, top);
+    } else if (y > prev_y) {
+        gfx_draw_vline(x, top, y - prev_y, GFX_MODE_SET);
+    } else {
+        gfx_draw_vline(x, GRAPH_Y + GRAPH_H - prev_y, prev_y - y, GFX_MODE_SET);
+    }
+}
+
+static void redraw_raw()
+{
+    gfx_clear_area(GRAPH_X, GRAPH_Y, GRAPH_W, GRAPH_H);
+
+    uint32_t count = sample_count < GRAPH_W ? sample_count : GRAPH_W;
+    int prev_y = -1;
+    for (uint32_t n = sample_count - count; n < sample_count; n++) {
+        int y = to_y(SAMPLE(n));
+        draw_column(GRAPH_X + GRAPH_W - (sample_count - n), y, prev_y);
+        prev_y = y;
+    }
+    last_y = prev_y;
+}
+
+// plot every bucket of the zoomed tier as a min-max bar with an average tick
+static void redraw_buckets()
+{
+    history_tier_t tier = zoom - 1;
+    int n = history_bucket_count(tier);
+    int col_w = GRAPH_W / history_bucket_capacity(tier);
+    int16_t min, avg, max;
+
+    gfx_clear_area(GRAPH_X, GRAPH_Y, GRAPH_W, GRAPH_H);
+
+    int16_t lo = INT16_MAX, hi = INT16_MIN;
+    for (int age = 0; age < n; age++) {
+        if (!history_get_bucket(tier, age, &min, &avg, &max)) continue;
+        if (min < lo) lo = min;
+        if (max > hi) hi = max;
+    }
+    if (lo > hi) return;
+    scale_lo = lo - GRAPH_MARGIN;
+    scale_hi = hi + GRAPH_MARGIN;
+    rescale = true;
+
+    for (int age = 0; age < n; age++) {
+        if (!history_get_bucket(tier, age, &min, &avg, &max)) continue;
+        int x = GRAPH_X + GRAPH_W - (age + 1) * col_w;
+        int y_max = GRAPH_Y + GRAPH_H - 1 - to_y(max);
+        gfx_draw_vline(x, y_max, to_y(max) - to_y(min) + 1, GFX_MODE_SET);
+        gfx_draw_hline(x, GRAPH_Y + GRAPH_H - 1 - to_y(avg), col_w - 1, GFX_MODE_SET);
+    }
+}
+
+void graph_init()
+{
+    sample_count = 0;
+    min_head = min_tail = max_head = max_tail = 0;
+    last_y = -1;
+    rescale = true;
+
+    // rebuild the window from whatever the history store already holds
+    uint32_t count = history_raw_count();
+    uint32_t n = count > GRAPH_W ? count - GRAPH_W : 0;
+    for (; n < count; n++) {
+        window_push(n);
+    }
+    gfx_clear_area(GRAPH_X, GRAPH_Y, GRAPH_W, GRAPH_H);
+}
+
+void graph_set_zoom(int level)
+{
+    zoom = level % GRAPH_ZOOM_LEVELS;
+    gfx_draw_text(GRAPH_W - 24, GRAPH_LABEL_Y, zoom_labels[zoom]);
+    if (zoom == GRAPH_ZOOM_RAW) {
+        rescale = true;
+    } else {
+        redraw_buckets();
+    }
+}
+
+int graph_get_zoom()
+{
+    return zoom;
+}
+
+// call after every history_append() with the tiers it completed
+void graph_update(uint32_t committed_tiers)
+{
+    uint32_t count = history_raw_count();
+    if (count == 0) return;
+    // columns can only be scrolled in one sample at a time
+    if (count - sample_count > 1) rescale = true;
+    for (uint32_t n = sample_count; n < count; n++) {
+        window_push(n);
+    }
+
+    if (zoom != GRAPH_ZOOM_RAW) {
+        if (committed_tiers & (1 << (zoom - 1))) redraw_buckets();
+        return;
+    }
+
+    int16_t temp = SAMPLE(count - 1);
+    int16_t min = SAMPLE(min_deque[min_head % GRAPH_W]);
+    int16_t max = SAMPLE(max_deque[max_head % GRAPH_W]);
+
+    // only rescale when the data leaves the view or the view is far too loose
+    if (rescale || min < scale_lo || max > scale_hi ||
+        (scale_hi - scale_lo) - (max - min) > 2 * GRAPH_MARGIN + GRAPH_HYSTERESIS) {
+        scale_lo = min - GRAPH_MARGIN;
+        scale_hi = max + GRAPH_MARGIN;
+        rescale = false;
+        ESP_LOGI(TAG, "rescale to %d - %d", scale_lo, scale_hi);
+        redraw_raw();
+        return;
+    }
+
+    // same scale: shift the existing columns and draw only the new one
+    gfx_scroll_left(GRAPH_X, GRAPH_Y, GRAPH_W, GRAPH_H, 1);
+    int y = to_y(temp);
+    draw_column(GRAPH_X + GRAPH_W - 1, y, last_y);
+    last_y = y;
+}
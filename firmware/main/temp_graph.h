@@ -0,0 +1,30 @@
+#ifndef TEMP_GRAPH_H
+#define TEMP_GRAPH_H
+
+#include <stdint.h>
+#include "history.h"
+#include "oled_gfx.h"
+
+#define GRAPH_X 0
+#define GRAPH_W GFX_WIDTH
+#if GFX_HEIGHT >= 64
+#define GRAPH_Y 32
+#define GRAPH_H 32
+#define GRAPH_LABEL_Y 20
+#else
+// 32 row panels keep two text lines above a half height graph
+#define GRAPH_Y 16
+#define GRAPH_H 16
+#define GRAPH_LABEL_Y 8
+#endif
+
+// zoom 0 plots raw samples, zoom n plots the buckets of history tier n - 1
+#define GRAPH_ZOOM_RAW    0
+#define GRAPH_ZOOM_LEVELS (HISTORY_TIERS + 1)
+
+void graph_init();
+void graph_update(uint32_t committed_tiers);
+void graph_set_zoom(int zoom);
+int graph_get_zoom();
+
+#endif // TEMP_GRAPH_H
@@ -1,59 +1,346 @@
 #define EXAMPLE_ONEWIRE_BUS_GPIO    0
-#define EXAMPLE_ONEWIRE_MAX_DS18B20 2
 
+#include "temp_sensor.h"
+#include "profile.h"
+#include "string.h"
+
+#include "sdkconfig.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
 #include "onewire_bus.h"
-#include "ds18b20.h"
+#include "onewire_crc.h"
+#include "nvs.h"
 #include "esp_log.h"
+#include "esp_check.h"
+
+#define TEMP_SENSOR_QUEUE_LEN       4
+#define TEMP_SENSOR_TASK_STACK      3072
+
+#define ONEWIRE_CMD_MATCH_ROM       0x55
+#define ONEWIRE_CMD_SKIP_ROM        0xCC
+#define DS18B20_CMD_CONVERT_TEMP    0x44
+#define DS18B20_CMD_READ_SCRATCHPAD 0xBE
+#define DS18B20_CMD_WRITE_SCRATCHPAD 0x4E
+// configuration register, resolution in bits 6:5
+#define DS18B20_CONFIG(bits)        ((((bits) - 9) << 5) | 0x1F)
+#define DS18B20_FAMILY_CODE         0x28
+// 85.00 C, what the temperature register holds until a conversion completes
+#define DS18B20_POWER_ON_RAW        0x0550
 
+// rom codes of the probes found last time
+#define SENSOR_NVS_NAMESPACE        "sensors"
+#define SENSOR_NVS_KEY              "roms"
 
 static const char *TAG = "TEMP_SENSOR";
-ds18b20_device_handle_t ds18b20s[EXAMPLE_ONEWIRE_MAX_DS18B20];
-int ds18b20_device_num = 0;
+static onewire_device_address_t ds18b20_addresses[EXAMPLE_ONEWIRE_MAX_DS18B20];
+static int ds18b20_device_num = 0;
 
-void init_temp_sensor(){
+static onewire_bus_handle_t bus = NULL;
+static QueueHandle_t sample_queue = NULL;
+static TaskHandle_t sensor_task_handle = NULL;
+static StaticQueue_t sample_queue_buf;
+static uint8_t sample_queue_storage[TEMP_SENSOR_QUEUE_LEN * sizeof(temp_sample_t)];
+static StaticTask_t sensor_task_buf;
+static StackType_t sensor_task_stack[TEMP_SENSOR_TASK_STACK];
+static esp_timer_handle_t sensor_timer = NULL;
+#if CONFIG_BEER_ADAPTIVE_RESOLUTION
+// the first sample comes quickly, the estimate picks the resolution from then on
+static volatile uint8_t requested_bits = TEMP_SENSOR_BITS_MIN;
+#else
+static volatile uint8_t requested_bits = TEMP_SENSOR_BITS_MAX;
+#endif
+static bool search_pending = false;
 
-    // install 1-wire bus
-    onewire_bus_handle_t bus = NULL;
-    onewire_bus_config_t bus_config = {
-        .bus_gpio_num = EXAMPLE_ONEWIRE_BUS_GPIO,
-    };
-    onewire_bus_rmt_config_t rmt_config = {
-        .max_rx_bytes = 10, // 1byte ROM command + 8byte ROM number + 1byte device command
-    };
-    ESP_ERROR_CHECK(onewire_new_bus_rmt(&bus_config, &rmt_config, &bus));
+// start a conversion on every device at once, the bus is idle while they convert
+// *early is set when the bus already reads done right after the command,
+// a probe that just reset may not have converted at all
+static esp_err_t start_conversion(bool *early)
+{
+    const uint8_t cmd[] = {ONEWIRE_CMD_SKIP_ROM, DS18B20_CMD_CONVERT_TEMP};
+    uint8_t done = 0;
+    ESP_RETURN_ON_ERROR(onewire_bus_reset(bus), TAG, "bus reset failed");
+    ESP_RETURN_ON_ERROR(onewire_bus_write_bytes(bus, cmd, sizeof(cmd)), TAG, "convert failed");
+    ESP_RETURN_ON_ERROR(onewire_bus_read_bit(bus, &done), TAG, "status read failed");
+    *early = done;
+    return ESP_OK;
+}
+
+// the same resolution for every device at once, the alarm bytes are unused
+static esp_err_t write_resolution(uint8_t bits)
+{
+    const uint8_t cmd[] = {ONEWIRE_CMD_SKIP_ROM, DS18B20_CMD_WRITE_SCRATCHPAD, 0, 0, DS18B20_CONFIG(bits)};
+    ESP_RETURN_ON_ERROR(onewire_bus_reset(bus), TAG, "bus reset failed");
+    return onewire_bus_write_bytes(bus, cmd, sizeof(cmd));
+}
+
+// after an early conversion the power-on value is taken for a reset probe
+static esp_err_t read_scratchpad(onewire_device_address_t address, uint8_t bits, bool early, int16_t *temperature)
+{
+    uint8_t tx[10] = {ONEWIRE_CMD_MATCH_ROM};
+    memcpy(&tx[1], &address, 8);
+    tx[9] = DS18B20_CMD_READ_SCRATCHPAD;
 
+    uint8_t scratchpad[9];
+    ESP_RETURN_ON_ERROR(onewire_bus_reset(bus), TAG, "bus reset failed");
+    ESP_RETURN_ON_ERROR(onewire_bus_write_bytes(bus, tx, sizeof(tx)), TAG, "send read scratchpad failed");
+    ESP_RETURN_ON_ERROR(onewire_bus_read_bytes(bus, scratchpad, sizeof(scratchpad)), TAG, "read scratchpad failed");
+    if (onewire_crc8(0, scratchpad, 8) != scratchpad[8]) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    // a shorted or stuck low bus reads all zeros, whose crc is zero too
+    uint8_t any = 0;
+    for (int i = 0; i < sizeof(scratchpad); i++) any |= scratchpad[i];
+    if (!any) return ESP_ERR_INVALID_RESPONSE;
+
+    // raw is in 1/16 C, scale to centi-degrees rounding half away from zero.
+    // below 12 bit the low bits are undefined, take the middle of the step
+    int16_t raw = (int16_t)(scratchpad[0] | (scratchpad[1] << 8));
+    if (early && raw == DS18B20_POWER_ON_RAW) return ESP_ERR_INVALID_STATE;
+    if (bits < TEMP_SENSOR_BITS_MAX) {
+        int16_t step = 1 << (TEMP_SENSOR_BITS_MAX - bits);
+        raw = (raw & ~(step - 1)) + step / 2;
+    }
+    *temperature = (raw * 25 + (raw < 0 ? -2 : 2)) / 4;
+    return ESP_OK;
+}
+
+// full rom search of the bus, only the DS18B20s are kept
+static int search_devices(onewire_device_address_t *found)
+{
     onewire_device_iter_handle_t iter = NULL;
     onewire_device_t next_onewire_device;
     esp_err_t search_result = ESP_OK;
+    int count = 0;
 
     // create 1-wire device iterator, which is used for device search
-    ESP_ERROR_CHECK(onewire_new_device_iter(bus, &iter));
-    ESP_LOGI(TAG, "Device iterator created, start searching...");
+    if (onewire_new_device_iter(bus, &iter) != ESP_OK) return 0;
     do {
         search_result = onewire_device_iter_get_next(iter, &next_onewire_device);
-        if (search_result == ESP_OK) { // found a new device, let's check if we can upgrade it to a DS18B20
-            ds18b20_config_t ds_cfg = {};
-            // check if the device is a DS18B20, if so, return the ds18b20 handle
-            if (ds18b20_new_device(&next_onewire_device, &ds_cfg, &ds18b20s[ds18b20_device_num]) == ESP_OK) {
-                ESP_LOGI(TAG, "Found a DS18B20[%d], address: %016llX", ds18b20_device_num, next_onewire_device.address);
-                ds18b20_device_num++;
+        if (search_result == ESP_OK && count < EXAMPLE_ONEWIRE_MAX_DS18B20) {
+            if ((next_onewire_device.address & 0xFF) == DS18B20_FAMILY_CODE) {
+                found[count++] = next_onewire_device.address;
             } else {
                 ESP_LOGI(TAG, "Found an unknown device, address: %016llX", next_onewire_device.address);
             }
         }
     } while (search_result != ESP_ERR_NOT_FOUND);
-    ESP_ERROR_CHECK(onewire_del_device_iter(iter));
-    ESP_LOGI(TAG, "Searching done, %d DS18B20 device(s) found", ds18b20_device_num);
+    onewire_del_device_iter(iter);
+    return count;
+}
 
-    // Now you have the DS18B20 sensor handle, you can use it to read the temperature
+static void use_devices(const onewire_device_address_t *addresses, int count)
+{
+    memcpy(ds18b20_addresses, addresses, count * sizeof(onewire_device_address_t));
+    ds18b20_device_num = count;
+    for (int i = 0; i < count; i++) {
+        ESP_LOGI(TAG, "DS18B20[%d], address: %016llX", i, addresses[i]);
+    }
+}
+
+static bool load_rom_table(onewire_device_address_t *addresses, int *count)
+{
+    nvs_handle_t handle;
+    if (nvs_open(SENSOR_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return false;
+    size_t size = EXAMPLE_ONEWIRE_MAX_DS18B20 * sizeof(onewire_device_address_t);
+    bool ok = nvs_get_blob(handle, SENSOR_NVS_KEY, addresses, &size) == ESP_OK && size > 0 &&
+              size % sizeof(onewire_device_address_t) == 0;
+    nvs_close(handle);
+    *count = ok ? size / sizeof(onewire_device_address_t) : 0;
+    return ok;
 }
 
-float get_temp(){
-    float temperature;
-    for (int i = 0; i < ds18b20_device_num; i ++) {
-        ESP_ERROR_CHECK(ds18b20_trigger_temperature_conversion(ds18b20s[i]));
-        ESP_ERROR_CHECK(ds18b20_get_temperature(ds18b20s[i], &temperature));
-        ESP_LOGI(TAG, "temperature read from DS18B20[%d]: %.2fC", i, temperature);
+static void save_rom_table(const onewire_device_address_t *addresses, int count)
+{
+    nvs_handle_t handle;
+    if (nvs_open(SENSOR_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return;
+    if (count == 0) {
+        nvs_erase_key(handle, SENSOR_NVS_KEY);
+    } else {
+        nvs_set_blob(handle, SENSOR_NVS_KEY, addresses, count * sizeof(onewire_device_address_t));
     }
-    return temperature;
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+// the probes of the last boot only have to answer, which takes a scratchpad
+// read each instead of a search. needs nvs to be initialised
+void init_temp_sensor(){
+
+    // install 1-wire bus
+    onewire_bus_config_t bus_config = {
+        .bus_gpio_num = EXAMPLE_ONEWIRE_BUS_GPIO,
+    };
+    onewire_bus_rmt_config_t rmt_config = {
+        .max_rx_bytes = 10, // 1byte ROM command + 8byte ROM number + 1byte device command
+    };
+    ESP_ERROR_CHECK(onewire_new_bus_rmt(&bus_config, &rmt_config, &bus));
+
+    onewire_device_address_t addresses[EXAMPLE_ONEWIRE_MAX_DS18B20];
+    int count;
+    if (load_rom_table(addresses, &count)) {
+        bool present = true;
+        int16_t temp;
+        for (int i = 0; i < count && present; i++) {
+            present = read_scratchpad(addresses[i], TEMP_SENSOR_BITS_MAX, false, &temp) == ESP_OK;
+        }
+        if (present) {
+            // a probe added since is found by the search in the background
+            // and used from the next boot
+            use_devices(addresses, count);
+            search_pending = true;
+            ESP_LOGI(TAG, "%d cached DS18B20 device(s) answered", count);
+            return;
+        }
+        ESP_LOGW(TAG, "cached DS18B20 missing, searching the bus");
+    }
+
+    count = search_devices(addresses);
+    use_devices(addresses, count);
+    save_rom_table(addresses, count);
+    ESP_LOGI(TAG, "Searching done, %d DS18B20 device(s) found", count);
+}
+
+// compare the bus with the table in use. the endpoints and fusion indices are
+// fixed at boot, so a change only goes to the cache for the next boot, and only
+// once two searches in a row agree on it. the probes kept stay in their order
+static void background_search()
+{
+    static onewire_device_address_t last[EXAMPLE_ONEWIRE_MAX_DS18B20];
+    static int last_count = -1;
+    onewire_device_address_t found[EXAMPLE_ONEWIRE_MAX_DS18B20];
+    onewire_device_address_t table[EXAMPLE_ONEWIRE_MAX_DS18B20];
+    int count = search_devices(found);
+    int table_count = 0;
+
+    for (int i = 0; i < ds18b20_device_num; i++) {
+        for (int j = 0; j < count; j++) {
+            if (found[j] == ds18b20_addresses[i]) table[table_count++] = found[j];
+        }
+    }
+    for (int j = 0; j < count; j++) {
+        bool known = false;
+        for (int i = 0; i < ds18b20_device_num; i++) known |= found[j] == ds18b20_addresses[i];
+        if (!known) table[table_count++] = found[j];
+    }
+
+    bool changed = table_count != ds18b20_device_num ||
+                   memcmp(table, ds18b20_addresses, table_count * sizeof(onewire_device_address_t)) != 0;
+    bool confirmed = table_count == last_count && memcmp(table, last, table_count * sizeof(onewire_device_address_t)) == 0;
+    memcpy(last, table, table_count * sizeof(onewire_device_address_t));
+    last_count = table_count;
+    if (!changed) return;
+    if (!confirmed) {
+        // could be a glitch on the bus, look again next period
+        search_pending = true;
+        return;
+    }
+
+    ESP_LOGW(TAG, "DS18B20s changed, %d device(s) from the next boot", table_count);
+    save_rom_table(table, table_count);
+}
+
+static void sensor_timer_cb(void *arg)
+{
+    xTaskNotifyGive(sensor_task_handle);
+}
+
+static void wait_us(uint64_t us)
+{
+    esp_timer_start_once(sensor_timer, us);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+static void temp_sensor_task(void *pvParameters)
+{
+    temp_sample_t sample = {
+        .count = ds18b20_device_num,
+        .bits = 0,  // unknown, a restart of the chip alone leaves the probes as they were
+    };
+
+    for(;;){
+        int64_t period_start = esp_timer_get_time();
+
+        uint8_t bits = requested_bits;
+        if (bits != sample.bits) {
+            if (write_resolution(bits) == ESP_OK) {
+                sample.bits = bits;
+            } else {
+                ESP_LOGW(TAG, "failed to set %d bit resolution", bits);
+                // still unknown, wait for the slowest conversion
+                if (!sample.bits) sample.bits = TEMP_SENSOR_BITS_MAX;
+            }
+        }
+
+        bool early;
+        if (start_conversion(&early) == ESP_OK) {
+            wait_us(DS18B20_CONVERSION_US(sample.bits));
+
+            int64_t read_start = profile_start();
+            sample.valid_mask = 0;
+            for (int i = 0; i < ds18b20_device_num; i++) {
+                if (read_scratchpad(ds18b20_addresses[i], sample.bits, early, &sample.temps[i]) == ESP_OK) {
+                    sample.valid_mask |= 1 << i;
+                } else {
+                    ESP_LOGW(TAG, "failed to read DS18B20[%d]", i);
+                }
+            }
+            sample.timestamp_us = esp_timer_get_time();
+            sample.seq++;
+            profile_end(PROFILE_SENSOR, read_start);
+
+            // drop the oldest sample when nobody is keeping up
+            if (xQueueSend(sample_queue, &sample, 0) != pdTRUE) {
+                temp_sample_t dropped;
+                xQueueReceive(sample_queue, &dropped, 0);
+                xQueueSend(sample_queue, &sample, 0);
+            }
+
+            // once control has its first sample, the bus has time for a search
+            if (search_pending) {
+                search_pending = false;
+                background_search();
+            }
+        } else {
+            ESP_LOGW(TAG, "no presence pulse on the 1-wire bus");
+        }
+
+        int64_t elapsed = esp_timer_get_time() - period_start;
+        if (elapsed < TEMP_SENSOR_PERIOD_US(sample.bits)) {
+            wait_us(TEMP_SENSOR_PERIOD_US(sample.bits) - elapsed);
+        }
+    }
+}
+
+void temp_sensor_start()
+{
+    sample_queue = xQueueCreateStatic(TEMP_SENSOR_QUEUE_LEN, sizeof(temp_sample_t), sample_queue_storage, &sample_queue_buf);
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = sensor_timer_cb,
+        .name = "temp_sensor",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &sensor_timer));
+
+    sensor_task_handle = xTaskCreateStatic(temp_sensor_task, "temp_sensor", TEMP_SENSOR_TASK_STACK, NULL, 6,
+                                           sensor_task_stack, &sensor_task_buf);
+    profile_register_task(sensor_task_handle);
+}
+
+int temp_sensor_count()
+{
+    return ds18b20_device_num;
+}
+
+// takes effect from the next conversion on
+void temp_sensor_set_resolution(uint8_t bits)
+{
+    if (bits < TEMP_SENSOR_BITS_MIN) bits = TEMP_SENSOR_BITS_MIN;
+    if (bits > TEMP_SENSOR_BITS_MAX) bits = TEMP_SENSOR_BITS_MAX;
+    requested_bits = bits;
+}
+
+bool temp_sensor_receive(temp_sample_t *sample, TickType_t timeout)
+{
+    return xQueueReceive(sample_queue, sample, timeout) == pdTRUE;
 }
@@ -1,7 +1,38 @@
 #ifndef TEMP_SENSOR_H
 #define TEMP_SENSOR_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+
+#define EXAMPLE_ONEWIRE_MAX_DS18B20 2
+// sample period of the conversion pipeline at full resolution, independent
+// of the consumers. every bit less halves both the conversion time and the period
+#define TEMP_SENSOR_PERIOD_MS       1000
+#define TEMP_SENSOR_BITS_MAX        12
+#define TEMP_SENSOR_BITS_MIN        9
+#define TEMP_SENSOR_PERIOD_US(bits) ((int64_t)TEMP_SENSOR_PERIOD_MS * 1000 >> (TEMP_SENSOR_BITS_MAX - (bits)))
+// worst case conversion time, 750 ms at 12 bit down to 93.75 ms at 9 bit
+#define DS18B20_CONVERSION_US(bits) (750000 >> (TEMP_SENSOR_BITS_MAX - (bits)))
+
+// temperatures are int16 centi-degrees celsius throughout, 2250 is 22.50 C,
+// INT16_MIN doubles as the zcl "invalid measured value"
+#define TEMP_INVALID INT16_MIN
+
+// one broadcast conversion, read back from every sensor on the bus
+typedef struct {
+    int64_t timestamp_us;   // esp_timer time at which the conversion finished
+    uint32_t seq;           // increments by one for every conversion
+    uint8_t count;          // number of sensors in temps[]
+    uint8_t valid_mask;     // bit i set when temps[i] passed the crc check
+    uint8_t bits;           // resolution of the conversion
+    int16_t temps[EXAMPLE_ONEWIRE_MAX_DS18B20];
+} temp_sample_t;
+
 void init_temp_sensor();
-float get_temp();
+void temp_sensor_start();
+int temp_sensor_count();
+void temp_sensor_set_resolution(uint8_t bits);
+bool temp_sensor_receive(temp_sample_t *sample, TickType_t timeout);
 
-#endif // TEMP_SENSOR_H
\ No newline at end of file
+#endif // TEMP_SENSOR_H
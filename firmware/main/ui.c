@@ -0,0 +1,236 @@
+#include "ui.h"
+#include "oled_gfx.h"
+#include "temp_graph.h"
+#include "temp_sensor.h"
+#include "string.h"
+#include "stdio.h"
+
+#define UI_GLYPH_W      8
+#define UI_TEXT_MAX     16
+
+typedef struct {
+    uint8_t x, y;
+    uint8_t chars;          // shorter content is padded with spaces to this
+    const char *label;      // unit of a readout, text of an icon
+} ui_layout_t;
+
+static const ui_layout_t layout[UI_WIDGETS] = {
+#if GFX_HEIGHT >= 64
+    [UI_TITLE] = {0, 0,  11, NULL},
+    [UI_TEMP]  = {0, 10, 8,  " C"},
+    [UI_HEAT]  = {0, 20, 9,  NULL},
+    [UI_ETA]   = {GFX_WIDTH - 40, 10, 5, NULL},
+#else
+    // no room for the title on 32 row panels
+    [UI_TITLE] = {0, 0,  0,  NULL},
+    [UI_TEMP]  = {0, 0,  8,  " C"},
+    [UI_HEAT]  = {0, 8,  9,  NULL},
+    [UI_ETA]   = {GFX_WIDTH - 56, 0, 5, NULL},
+#endif
+    [UI_ZB]    = {GFX_WIDTH - 16, 0, 2, "zb"},
+};
+
+// what the setters asked for, guarded by ui_lock, and what is on the
+// framebuffer, which only the render task touches
+static char wanted[UI_WIDGETS][UI_TEXT_MAX + 1];
+static char drawn[UI_WIDGETS][UI_TEXT_MAX + 1];
+static int16_t readouts[UI_WIDGETS];
+static bool readout_set[UI_WIDGETS];
+static uint32_t dirty_mask = 0;
+static uint32_t graph_tiers = 0;
+static bool graph_pending = false;
+static int graph_zooms = 0;
+static TaskHandle_t render_task = NULL;
+static portMUX_TYPE ui_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// "-12.34", without pulling in the float printf
+int format_temp(char *buf, int16_t temp)
+{
+    int len = 0;
+    int value = temp;
+    if (value < 0) {
+        buf[len++] = '-';
+        value = -value;
+    }
+
+    char digits[5];
+    int n = 0;
+    int whole = value / 100;
+    do {
+        digits[n++] = '0' + whole % 10;
+        whole /= 10;
+    } while (whole);
+    while (n) buf[len++] = digits[--n];
+
+    buf[len++] = '.';
+    buf[len++] = '0' + (value / 10) % 10;
+    buf[len++] = '0' + value % 10;
+    buf[len] = '\0';
+    return len;
+}
+
+static void pad(char *dst, const char *text, int chars)
+{
+    int len = strnlen(text, chars);
+    memcpy(dst, text, len);
+    memset(dst + len, ' ', chars - len);
+    dst[chars] = '\0';
+}
+
+static void wake_render_task()
+{
+    if (render_task) xTaskNotifyGive(render_task);
+}
+
+static void set_content(ui_widget_t id, const char *text)
+{
+    char padded[UI_TEXT_MAX + 1];
+    pad(padded, text, layout[id].chars);
+
+    portENTER_CRITICAL(&ui_lock);
+    bool changed = strcmp(padded, wanted[id]) != 0;
+    if (changed) {
+        strcpy(wanted[id], padded);
+        dirty_mask |= 1u << id;
+    }
+    portEXIT_CRITICAL(&ui_lock);
+
+    if (changed) wake_render_task();
+}
+
+void ui_set_render_task(TaskHandle_t task)
+{
+    render_task = task;
+    wake_render_task();
+}
+
+void ui_set_text(ui_widget_t id, const char *text)
+{
+    set_content(id, text);
+}
+
+// unchanged values don't even get formatted
+void ui_set_readout(ui_widget_t id, int16_t centi)
+{
+    portENTER_CRITICAL(&ui_lock);
+    bool same = readout_set[id] && readouts[id] == centi;
+    readouts[id] = centi;
+    readout_set[id] = true;
+    portEXIT_CRITICAL(&ui_lock);
+    if (same) return;
+
+    // dashes for a lost sensor
+    char str[UI_TEXT_MAX + 1] = "--.--";
+    int len = centi == TEMP_INVALID ? strlen(str) : format_temp(str, centi);
+    strcpy(&str[len], layout[id].label);
+    set_content(id, str);
+}
+
+void ui_set_icon(ui_widget_t id, bool on)
+{
+    set_content(id, on ? layout[id].label : "");
+}
+
+// "h:mm" rounded up, blank at 0 and dashes when negative, for unknown
+void ui_set_duration(ui_widget_t id, int32_t seconds)
+{
+    char str[UI_TEXT_MAX + 1];
+    int32_t minutes = (seconds + 59) / 60;
+    if (seconds == 0) {
+        str[0] = '\0';
+    } else if (seconds < 0 || minutes > 99 * 60 + 59) {
+        strcpy(str, "--:--");
+    } else {
+        snprintf(str, sizeof(str), "%ld:%02ld", (long)(minutes / 60), (long)(minutes % 60));
+    }
+    set_content(id, str);
+}
+
+// samples add up until the next render, the graph catches up on all of them
+void ui_graph_sample(uint32_t committed_tiers)
+{
+    portENTER_CRITICAL(&ui_lock);
+    graph_tiers |= committed_tiers;
+    graph_pending = true;
+    portEXIT_CRITICAL(&ui_lock);
+    wake_render_task();
+}
+
+void ui_graph_zoom()
+{
+    portENTER_CRITICAL(&ui_lock);
+    graph_zooms++;
+    portEXIT_CRITICAL(&ui_lock);
+    wake_render_task();
+}
+
+// a blank screen and everything drawn from scratch, content set before
+// this call is kept
+void ui_init()
+{
+    gfx_clear_area(0, 0, GFX_WIDTH, GFX_HEIGHT);
+    portENTER_CRITICAL(&ui_lock);
+    for (int i = 0; i < UI_WIDGETS; i++) {
+        pad(drawn[i], "", layout[i].chars);
+        if (!wanted[i][0]) pad(wanted[i], "", layout[i].chars);
+        dirty_mask |= 1u << i;
+    }
+    graph_tiers = 0;
+    graph_pending = false;
+    portEXIT_CRITICAL(&ui_lock);
+
+    ui_set_text(UI_TITLE, "Beer warmer");
+    graph_init();
+    ui_render();
+}
+
+// only the glyphs that differ from the screen are drawn, so gfx marks just
+// their columns for the flush
+static bool render_text(ui_widget_t id, const char *text)
+{
+    const ui_layout_t *w = &layout[id];
+    char glyph[2] = {0};
+    bool drew = false;
+    for (int i = 0; i < w->chars; i++) {
+        if (text[i] == drawn[id][i]) continue;
+        glyph[0] = text[i];
+        gfx_draw_text(w->x + i * UI_GLYPH_W, w->y, glyph);
+        drawn[id][i] = text[i];
+        drew = true;
+    }
+    return drew;
+}
+
+// render task only, returns whether anything was drawn
+bool ui_render()
+{
+    char text[UI_WIDGETS][UI_TEXT_MAX + 1];
+
+    portENTER_CRITICAL(&ui_lock);
+    uint32_t mask = dirty_mask;
+    dirty_mask = 0;
+    for (int i = 0; i < UI_WIDGETS; i++) {
+        if (mask & (1u << i)) memcpy(text[i], wanted[i], sizeof(text[i]));
+    }
+    uint32_t tiers = graph_tiers;
+    bool sample = graph_pending;
+    int zooms = graph_zooms;
+    graph_tiers = 0;
+    graph_pending = false;
+    graph_zooms = 0;
+    portEXIT_CRITICAL(&ui_lock);
+
+    bool drew = false;
+    for (int i = 0; i < UI_WIDGETS; i++) {
+        if (mask & (1u << i)) drew |= render_text(i, text[i]);
+    }
+    if (zooms) {
+        graph_set_zoom(graph_get_zoom() + zooms);
+        drew = true;
+    }
+    if (sample) {
+        graph_update(tiers);
+        drew = true;
+    }
+    return drew;
+}
@@ -0,0 +1,34 @@
+#ifndef UI_H
+#define UI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// the widgets of the fixed layout, the graph panel below them is separate
+typedef enum {
+    UI_TITLE,   // text
+    UI_TEMP,    // readout in centi-degrees
+    UI_HEAT,    // text
+    UI_ZB,      // icon
+    UI_ETA,     // duration in seconds
+    UI_WIDGETS,
+} ui_widget_t;
+
+// the setters only store the new content, any task may call them. the
+// render task is woken when something actually changed and is the only
+// one drawing, ui_render redraws just the glyphs that differ from the screen
+void ui_init();
+void ui_set_render_task(TaskHandle_t task);
+void ui_set_text(ui_widget_t id, const char *text);
+void ui_set_readout(ui_widget_t id, int16_t centi);
+void ui_set_icon(ui_widget_t id, bool on);
+void ui_set_duration(ui_widget_t id, int32_t seconds);
+void ui_graph_sample(uint32_t committed_tiers);
+void ui_graph_zoom();
+bool ui_render();
+
+int format_temp(char *buf, int16_t temp);
+
+#endif // UI_H
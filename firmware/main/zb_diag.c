@@ -0,0 +1,104 @@
+#include "zb_diag.h"
+#include "main.h"
+#include "profile.h"
+#include "power.h"
+#include "zb_report.h"
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+
+#define DIAG_REFRESH_US ((int64_t)CONFIG_BEER_DIAG_REFRESH * 1000000)
+
+static const char *TAG = "ZB_DIAG";
+
+// backing storage for the attributes, the stack keeps its own copy
+static uint32_t stage_values[PROFILE_STAGES][ZB_DIAG_FIELDS];
+static uint16_t stack_free[PROFILE_MAX_TASKS];
+static uint32_t uptime_s;
+static uint32_t light_sleep_s;
+static uint32_t reports_sent;
+static uint32_t reports_held;
+static uint32_t heap_free;
+static uint32_t heap_min_free;
+static uint32_t heap_largest;
+static int64_t last_refresh_us = -1;
+
+esp_zb_attribute_list_t *zb_diag_cluster_create()
+{
+    esp_zb_attribute_list_t *cluster = esp_zb_zcl_attr_list_create(ZB_DIAG_CLUSTER_ID);
+    uint8_t access = ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY;
+    for (int stage = 0; stage < PROFILE_STAGES; stage++) {
+        for (int field = 0; field < ZB_DIAG_FIELDS; field++) {
+            esp_zb_custom_cluster_add_custom_attr(cluster, ZB_DIAG_ATTR_STAGE(stage) + field, ESP_ZB_ZCL_ATTR_TYPE_U32, access, &stage_values[stage][field]);
+        }
+    }
+    for (int i = 0; i < PROFILE_MAX_TASKS; i++) {
+        esp_zb_custom_cluster_add_custom_attr(cluster, ZB_DIAG_ATTR_STACK(i), ESP_ZB_ZCL_ATTR_TYPE_U16, access, &stack_free[i]);
+    }
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_DIAG_ATTR_UPTIME, ESP_ZB_ZCL_ATTR_TYPE_U32, access, &uptime_s);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_DIAG_ATTR_LIGHT_SLEEP, ESP_ZB_ZCL_ATTR_TYPE_U32, access, &light_sleep_s);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_DIAG_ATTR_REPORTS_SENT, ESP_ZB_ZCL_ATTR_TYPE_U32, access, &reports_sent);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_DIAG_ATTR_REPORTS_HELD, ESP_ZB_ZCL_ATTR_TYPE_U32, access, &reports_held);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_DIAG_ATTR_HEAP_FREE, ESP_ZB_ZCL_ATTR_TYPE_U32, access, &heap_free);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_DIAG_ATTR_HEAP_MIN_FREE, ESP_ZB_ZCL_ATTR_TYPE_U32, access, &heap_min_free);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_DIAG_ATTR_HEAP_LARGEST, ESP_ZB_ZCL_ATTR_TYPE_U32, access, &heap_largest);
+    return cluster;
+}
+
+static void set_attr(uint16_t attr, void *value)
+{
+    esp_zb_zcl_set_attribute_val(HA_ESP_ENDPOINT, ZB_DIAG_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr, value, false);
+}
+
+// cheap to call every sample, only copies the numbers into the zcl
+// attributes once per refresh interval
+void zb_diag_update(int64_t now_us)
+{
+    if (last_refresh_us >= 0 && now_us - last_refresh_us < DIAG_REFRESH_US) return;
+    last_refresh_us = now_us;
+
+    for (int stage = 0; stage < PROFILE_STAGES; stage++) {
+        profile_summary_t s;
+        profile_get(stage, &s);
+        stage_values[stage][ZB_DIAG_FIELD_COUNT] = s.count;
+        stage_values[stage][ZB_DIAG_FIELD_MIN] = s.min_us;
+        stage_values[stage][ZB_DIAG_FIELD_AVG] = s.avg_us;
+        stage_values[stage][ZB_DIAG_FIELD_MAX] = s.max_us;
+        stage_values[stage][ZB_DIAG_FIELD_P99] = s.p99_us;
+    }
+    for (int i = 0; i < profile_task_count(); i++) {
+        stack_free[i] = uxTaskGetStackHighWaterMark(profile_get_task(i));
+    }
+    power_stats_t power;
+    power_get_stats(&power);
+    uptime_s = power.uptime_us / 1000000;
+    light_sleep_s = power.light_sleep_us / 1000000;
+    zb_report_stats_t report;
+    zb_report_get_stats(&report);
+    reports_sent = report.sent;
+    reports_held = report.suppressed;
+    heap_free = esp_get_free_heap_size();
+    heap_min_free = esp_get_minimum_free_heap_size();
+    heap_largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    if (!esp_zb_lock_acquire(portMAX_DELAY)) return;
+    for (int stage = 0; stage < PROFILE_STAGES; stage++) {
+        for (int field = 0; field < ZB_DIAG_FIELDS; field++) {
+            set_attr(ZB_DIAG_ATTR_STAGE(stage) + field, &stage_values[stage][field]);
+        }
+    }
+    for (int i = 0; i < profile_task_count(); i++) {
+        set_attr(ZB_DIAG_ATTR_STACK(i), &stack_free[i]);
+    }
+    set_attr(ZB_DIAG_ATTR_UPTIME, &uptime_s);
+    set_attr(ZB_DIAG_ATTR_LIGHT_SLEEP, &light_sleep_s);
+    set_attr(ZB_DIAG_ATTR_REPORTS_SENT, &reports_sent);
+    set_attr(ZB_DIAG_ATTR_REPORTS_HELD, &reports_held);
+    set_attr(ZB_DIAG_ATTR_HEAP_FREE, &heap_free);
+    set_attr(ZB_DIAG_ATTR_HEAP_MIN_FREE, &heap_min_free);
+    set_attr(ZB_DIAG_ATTR_HEAP_LARGEST, &heap_largest);
+    esp_zb_lock_release();
+    ESP_LOGD(TAG, "diagnostics refreshed");
+}
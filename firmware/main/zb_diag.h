@@ -0,0 +1,37 @@
+#ifndef ZB_DIAG_H
+#define ZB_DIAG_H
+
+#include <stdint.h>
+#include "esp_zigbee_core.h"
+
+// manufacturer specific cluster on HA_ESP_ENDPOINT with the profiling data,
+// all attributes are read only and refreshed every BEER_DIAG_REFRESH seconds
+#define ZB_DIAG_CLUSTER_ID          0xFC01
+
+// per hot path stage (profile_stage_t), all uint32 in us except the count
+#define ZB_DIAG_ATTR_STAGE(stage)   ((stage) << 4)
+#define ZB_DIAG_FIELD_COUNT         0x0
+#define ZB_DIAG_FIELD_MIN           0x1
+#define ZB_DIAG_FIELD_AVG           0x2
+#define ZB_DIAG_FIELD_MAX           0x3
+#define ZB_DIAG_FIELD_P99           0x4
+#define ZB_DIAG_FIELDS              5
+
+// uint16, free stack in bytes of every task registered with profile
+#define ZB_DIAG_ATTR_STACK(task)    (0x0100 + (task))
+
+// uint32, seconds
+#define ZB_DIAG_ATTR_UPTIME         0x0200
+#define ZB_DIAG_ATTR_LIGHT_SLEEP    0x0201
+// uint32, zb_report counters
+#define ZB_DIAG_ATTR_REPORTS_SENT   0x0202
+#define ZB_DIAG_ATTR_REPORTS_HELD   0x0203
+// uint32, bytes of heap free now, at its lowest and in the largest block
+#define ZB_DIAG_ATTR_HEAP_FREE      0x0204
+#define ZB_DIAG_ATTR_HEAP_MIN_FREE  0x0205
+#define ZB_DIAG_ATTR_HEAP_LARGEST   0x0206
+
+esp_zb_attribute_list_t *zb_diag_cluster_create();
+void zb_diag_update(int64_t now_us);
+
+#endif // ZB_DIAG_H
@@ -0,0 +1,205 @@
+#include "zb_history.h"
+#include "main.h"
+#include "telemetry.h"
+#include "string.h"
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+// a frame fits one aps frame without fragmentation by the stack
+#define FRAME_MAX           64
+#define FRAME_HEADER_LEN    15      // octet string length and the fixed fields
+#define FRAME_RECORD_MAX    8       // two varints of a sample
+// frames are paced so a long transfer doesn't crowd out the reports
+#define FRAME_GAP_MS        100
+
+static const char *TAG = "ZB_HISTORY";
+
+// backing storage for the attributes, the stack keeps its own copy
+static uint32_t oldest_seq;
+static uint32_t next_seq;
+static uint16_t boot;
+static uint16_t interval_s = CONFIG_BEER_TELEMETRY_INTERVAL;
+
+// the transfer in progress, only touched from the zigbee task
+static struct {
+    bool active;
+    uint16_t dst_addr;
+    uint8_t dst_endpoint;
+    int32_t block;          // telemetry block holding seq
+    uint32_t seq;           // next sample to send
+    uint32_t remaining;     // samples still asked for
+} transfer;
+
+typedef struct {
+    uint8_t data[FRAME_MAX];
+    int len;
+    uint8_t count;
+    bool full;
+    uint16_t boot;
+    uint32_t time_s;
+    int16_t temp;
+} frame_t;
+
+esp_zb_attribute_list_t *zb_history_cluster_create()
+{
+    esp_zb_attribute_list_t *cluster = esp_zb_zcl_attr_list_create(ZB_HISTORY_CLUSTER_ID);
+    uint8_t access = ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY;
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_HISTORY_ATTR_OLDEST, ESP_ZB_ZCL_ATTR_TYPE_U32, access, &oldest_seq);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_HISTORY_ATTR_NEXT, ESP_ZB_ZCL_ATTR_TYPE_U32, access, &next_seq);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_HISTORY_ATTR_BOOT, ESP_ZB_ZCL_ATTR_TYPE_U16, access, &boot);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_HISTORY_ATTR_INTERVAL, ESP_ZB_ZCL_ATTR_TYPE_U16, access, &interval_s);
+    return cluster;
+}
+
+static void set_attr(uint16_t attr, void *value)
+{
+    esp_zb_zcl_set_attribute_val(HA_ESP_ENDPOINT, ZB_HISTORY_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr, value, false);
+}
+
+// cheap to call every sample, the range only moves when a block is written
+void zb_history_update()
+{
+    telemetry_range_t range;
+    telemetry_get_range(&range);
+    if (range.oldest_seq == oldest_seq && range.next_seq == next_seq && range.boot == boot) return;
+    oldest_seq = range.oldest_seq;
+    next_seq = range.next_seq;
+    boot = range.boot;
+
+    if (!esp_zb_lock_acquire(portMAX_DELAY)) return;
+    set_attr(ZB_HISTORY_ATTR_OLDEST, &oldest_seq);
+    set_attr(ZB_HISTORY_ATTR_NEXT, &next_seq);
+    set_attr(ZB_HISTORY_ATTR_BOOT, &boot);
+    esp_zb_lock_release();
+}
+
+static int put_varint(uint8_t *buf, uint32_t value)
+{
+    int n = 0;
+    while (value >= 0x80) {
+        buf[n++] = value | 0x80;
+        value >>= 7;
+    }
+    buf[n++] = value;
+    return n;
+}
+
+static void put_le(uint8_t *buf, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        buf[i] = value >> (8 * i);
+    }
+}
+
+// the same delta encoding as the flash log, a frame ends at a reboot
+// because the uptime starts over
+static void add_record(const telemetry_record_t *rec, void *ctx)
+{
+    frame_t *f = ctx;
+    if (f->full) return;
+
+    if (f->count == 0) {
+        put_le(&f->data[1], rec->seq, 4);
+        f->data[6] = rec->heater ? ZB_HISTORY_FLAG_HEATER : 0;
+        put_le(&f->data[7], rec->boot, 2);
+        put_le(&f->data[9], rec->time_s, 4);
+        put_le(&f->data[13], (uint16_t)rec->temp, 2);
+    } else {
+        if (rec->boot != f->boot || f->len + FRAME_RECORD_MAX > FRAME_MAX ||
+            f->count == transfer.remaining || f->count == UINT8_MAX) {
+            f->full = true;
+            return;
+        }
+        int32_t delta = rec->temp - f->temp;
+        uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+        f->len += put_varint(&f->data[f->len], rec->time_s - f->time_s);
+        f->len += put_varint(&f->data[f->len], zigzag << 1 | rec->heater);
+    }
+    f->count++;
+    f->boot = rec->boot;
+    f->time_s = rec->time_s;
+    f->temp = rec->temp;
+}
+
+static void send_frame(frame_t *f)
+{
+    f->data[0] = f->len - 1;   // octet string length
+    f->data[5] = f->count;
+
+    esp_zb_zcl_custom_cluster_cmd_t cmd = {
+        .zcl_basic_cmd = {
+            .dst_addr_u.addr_short = transfer.dst_addr,
+            .dst_endpoint = transfer.dst_endpoint,
+            .src_endpoint = HA_ESP_ENDPOINT,
+        },
+        .address_mode = ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT,
+        .profile_id = ESP_ZB_AF_HA_PROFILE_ID,
+        .cluster_id = ZB_HISTORY_CLUSTER_ID,
+        .custom_cmd_id = ZB_HISTORY_CMD_FRAME,
+        .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_CLI,
+        .data = {
+            .type = ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING,
+            .size = f->len,
+            .value = f->data,
+        },
+    };
+    esp_zb_zcl_custom_cluster_cmd_req(&cmd);
+}
+
+// one frame per alarm, a block is read again when a frame ends inside it
+static void send_next_frame(uint8_t param)
+{
+    if (!transfer.active) return;
+
+    frame_t f = {.len = FRAME_HEADER_LEN};
+    put_le(&f.data[1], transfer.seq, 4);
+    while (transfer.block >= 0 && !f.full && f.count < transfer.remaining) {
+        int32_t next = telemetry_read_block(transfer.block, transfer.seq + f.count, add_record, &f);
+        if (!f.full) transfer.block = next;
+    }
+    transfer.seq += f.count;
+    transfer.remaining -= f.count;
+
+    bool last = transfer.block < 0 || transfer.remaining == 0 || f.count == 0;
+    if (last) {
+        f.data[6] |= ZB_HISTORY_FLAG_LAST;
+        transfer.active = false;
+        ESP_LOGI(TAG, "transfer to 0x%04x done at #%lu", transfer.dst_addr, (unsigned long)transfer.seq);
+    }
+    send_frame(&f);
+    if (!last) {
+        esp_zb_scheduler_alarm(send_next_frame, 0, FRAME_GAP_MS);
+    }
+}
+
+// runs in the zigbee task, a new request replaces the transfer in progress
+esp_err_t zb_history_handle_command(const esp_zb_zcl_custom_cluster_command_message_t *message)
+{
+    if (message->info.cluster != ZB_HISTORY_CLUSTER_ID) return ESP_OK;
+    if (message->info.command.id != ZB_HISTORY_CMD_GET || message->data.size < 6) {
+        ESP_LOGW(TAG, "unknown command 0x%02x", message->info.command.id);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    const uint8_t *payload = message->data.value;
+    uint32_t first = payload[0] | payload[1] << 8 | payload[2] << 16 | (uint32_t)payload[3] << 24;
+    uint16_t max = payload[4] | payload[5] << 8;
+
+    if (transfer.active) esp_zb_scheduler_alarm_cancel(send_next_frame, 0);
+    transfer.active = true;
+    transfer.dst_addr = message->info.src_address.u.short_addr;
+    transfer.dst_endpoint = message->info.src_endpoint;
+    transfer.block = telemetry_find_block(first);
+    transfer.seq = first;
+    transfer.remaining = max ? max : UINT32_MAX;
+
+    // an overwritten start resumes at the oldest sample still there
+    telemetry_range_t range;
+    telemetry_get_range(&range);
+    if (transfer.seq < range.oldest_seq) transfer.seq = range.oldest_seq;
+
+    ESP_LOGI(TAG, "transfer to 0x%04x from #%lu", transfer.dst_addr, (unsigned long)transfer.seq);
+    send_next_frame(0);
+    return ESP_OK;
+}
@@ -0,0 +1,30 @@
+#ifndef ZB_HISTORY_H
+#define ZB_HISTORY_H
+
+#include <stdint.h>
+#include "esp_zigbee_core.h"
+
+// manufacturer specific cluster on HA_ESP_ENDPOINT serving the telemetry
+// log, so the coordinator can backfill its time series after an outage.
+// samples are numbered by the log and keep counting across reboots
+#define ZB_HISTORY_CLUSTER_ID       0xFC02
+#define ZB_HISTORY_ATTR_OLDEST      0x0000  // uint32, first sample still logged
+#define ZB_HISTORY_ATTR_NEXT        0x0001  // uint32, first sample not readable yet
+#define ZB_HISTORY_ATTR_BOOT        0x0002  // uint16, boot of the current run
+#define ZB_HISTORY_ATTR_INTERVAL    0x0003  // uint16, seconds between samples
+
+// client to server: uint32 first sample, uint16 max samples (0 for all)
+#define ZB_HISTORY_CMD_GET          0x00
+// server to client, octet string: uint32 first sample, uint8 count,
+// uint8 flags, uint16 boot, uint32 uptime s, int16 centi-degrees, then
+// for every further sample varint(dt) varint(zigzag(dtemp) << 1 | heater).
+// a transfer is a train of these, resume it from first sample + count
+#define ZB_HISTORY_CMD_FRAME        0x01
+#define ZB_HISTORY_FLAG_HEATER      0x01    // heater of the first sample
+#define ZB_HISTORY_FLAG_LAST        0x02    // no more frames follow
+
+esp_zb_attribute_list_t *zb_history_cluster_create();
+esp_err_t zb_history_handle_command(const esp_zb_zcl_custom_cluster_command_message_t *message);
+void zb_history_update();
+
+#endif // ZB_HISTORY_H
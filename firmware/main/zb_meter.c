@@ -0,0 +1,115 @@
+#include "zb_meter.h"
+#include "main.h"
+#include "zb_report.h"
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+// measurement type bits of the zcl spec
+#if CONFIG_BEER_METER_AC
+#define MEASURED_TYPE       0x00000001  // active, ac
+#define ATTR_VOLTAGE        ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_ID
+#define ATTR_CURRENT        ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_ID
+#define ATTR_POWER          ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACTIVE_POWER_ID
+#define ATTR_VOLTAGE_MUL    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACVOLTAGE_MULTIPLIER_ID
+#define ATTR_VOLTAGE_DIV    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACVOLTAGE_DIVISOR_ID
+#define ATTR_CURRENT_MUL    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACCURRENT_MULTIPLIER_ID
+#define ATTR_CURRENT_DIV    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACCURRENT_DIVISOR_ID
+#define ATTR_POWER_MUL      ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACPOWER_MULTIPLIER_ID
+#define ATTR_POWER_DIV      ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACPOWER_DIVISOR_ID
+#else
+#define MEASURED_TYPE       0x00000040  // dc
+#define ATTR_VOLTAGE        ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_DCVOLTAGE_ID
+#define ATTR_CURRENT        ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_DCCURRENT_ID
+#define ATTR_POWER          ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_DCPOWER_ID
+#define ATTR_VOLTAGE_MUL    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_DCVOLTAGE_MULTIPLIER_ID
+#define ATTR_VOLTAGE_DIV    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_DCVOLTAGE_DIVISOR_ID
+#define ATTR_CURRENT_MUL    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_DCCURRENT_MULTIPLIER_ID
+#define ATTR_CURRENT_DIV    ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_DCCURRENT_DIVISOR_ID
+#define ATTR_POWER_MUL      ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_DCPOWER_MULTIPLIER_ID
+#define ATTR_POWER_DIV      ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_DCPOWER_DIVISOR_ID
+#endif
+
+static const char *TAG = "ZB_METER";
+
+// backing storage for the attributes, the stack keeps its own copy
+static uint16_t voltage_dv;
+static uint16_t current_ma;
+static int16_t power_dw;
+static uint16_t one = 1;
+static uint16_t ten = 10;
+static uint16_t thousand = 1000;
+
+static esp_zb_uint48_t summation_wh;
+static esp_zb_int24_t demand_w;
+static esp_zb_uint24_t metering_mul = {.low = 1};
+static esp_zb_uint24_t metering_div = {.low = 1000};
+
+static int64_t last_timestamp_us = 0;
+static bool fault = false;
+
+void zb_meter_add_clusters(esp_zb_cluster_list_t *cluster_list)
+{
+    esp_zb_electrical_meas_cluster_cfg_t meas_cfg = {
+        .measured_type = MEASURED_TYPE,
+    };
+    esp_zb_attribute_list_t *meas = esp_zb_electrical_meas_cluster_create(&meas_cfg);
+    esp_zb_electrical_meas_cluster_add_attr(meas, ATTR_VOLTAGE, &voltage_dv);
+    esp_zb_electrical_meas_cluster_add_attr(meas, ATTR_CURRENT, &current_ma);
+    esp_zb_electrical_meas_cluster_add_attr(meas, ATTR_POWER, &power_dw);
+    esp_zb_electrical_meas_cluster_add_attr(meas, ATTR_VOLTAGE_MUL, &one);
+    esp_zb_electrical_meas_cluster_add_attr(meas, ATTR_VOLTAGE_DIV, &ten);
+    esp_zb_electrical_meas_cluster_add_attr(meas, ATTR_CURRENT_MUL, &one);
+    esp_zb_electrical_meas_cluster_add_attr(meas, ATTR_CURRENT_DIV, &thousand);
+    esp_zb_electrical_meas_cluster_add_attr(meas, ATTR_POWER_MUL, &one);
+    esp_zb_electrical_meas_cluster_add_attr(meas, ATTR_POWER_DIV, &ten);
+    esp_zb_cluster_list_add_electrical_meas_cluster(cluster_list, meas, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+
+    esp_zb_metering_cluster_cfg_t metering_cfg = {
+        .uint_of_measure = ESP_ZB_ZCL_METERING_UNIT_KW_KWH_BINARY,
+        .metering_device_type = ESP_ZB_ZCL_METERING_ELECTRIC_METERING,
+    };
+    esp_zb_attribute_list_t *metering = esp_zb_metering_cluster_create(&metering_cfg);
+    esp_zb_metering_cluster_add_attr(metering, ESP_ZB_ZCL_ATTR_METERING_MULTIPLIER_ID, &metering_mul);
+    esp_zb_metering_cluster_add_attr(metering, ESP_ZB_ZCL_ATTR_METERING_DIVISOR_ID, &metering_div);
+    esp_zb_metering_cluster_add_attr(metering, ESP_ZB_ZCL_ATTR_METERING_INSTANTANEOUS_DEMAND_ID, &demand_w);
+    esp_zb_cluster_list_add_metering_cluster(cluster_list, metering, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+}
+
+static void set_attr(uint16_t cluster, uint16_t attr, void *value)
+{
+    esp_zb_zcl_set_attribute_val(HA_ESP_ENDPOINT, cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr, value, false);
+}
+
+// only copies a reading the meter hasn't handed out before, reporting of
+// these standard attributes is left to the coordinator's configuration
+void zb_meter_update(const meter_reading_t *reading)
+{
+    if (reading->timestamp_us == last_timestamp_us) return;
+    last_timestamp_us = reading->timestamp_us;
+
+    voltage_dv = reading->voltage_mv / 100;
+    current_ma = reading->current_ma > UINT16_MAX ? UINT16_MAX : reading->current_ma;
+    // the meter keeps the last on power, zigbee wants what flows right now
+    uint32_t power_mw = reading->current_ma ? reading->power_mw : 0;
+    power_dw = power_mw / 100 > INT16_MAX ? INT16_MAX : power_mw / 100;
+    int32_t watts = power_mw / 1000;
+    uint64_t wh = reading->energy_mwh / 1000;
+    summation_wh = (esp_zb_uint48_t){.low = wh & UINT32_MAX, .high = wh >> 32};
+    demand_w = (esp_zb_int24_t){.low = watts & UINT16_MAX, .high = watts >> 16};
+
+    if (!esp_zb_lock_acquire(portMAX_DELAY)) return;
+    set_attr(ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ATTR_VOLTAGE, &voltage_dv);
+    set_attr(ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ATTR_CURRENT, &current_ma);
+    set_attr(ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ATTR_POWER, &power_dw);
+    set_attr(ESP_ZB_ZCL_CLUSTER_ID_METERING, ESP_ZB_ZCL_ATTR_METERING_CURRENT_SUMMATION_DELIVERED_ID, &summation_wh);
+    set_attr(ESP_ZB_ZCL_CLUSTER_ID_METERING, ESP_ZB_ZCL_ATTR_METERING_INSTANTANEOUS_DEMAND_ID, &demand_w);
+    esp_zb_lock_release();
+
+    // a broken element is news, it doesn't wait for any interval
+    if (reading->open_element != fault) {
+        fault = reading->open_element;
+        zb_report_heater_fault(fault);
+    }
+    ESP_LOGD(TAG, "%u dV, %u mA, %d dW, %lu Wh", voltage_dv, current_ma, power_dw, (unsigned long)wh);
+}
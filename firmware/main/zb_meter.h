@@ -0,0 +1,15 @@
+#ifndef ZB_METER_H
+#define ZB_METER_H
+
+#include <stdint.h>
+#include "esp_zigbee_core.h"
+#include "meter.h"
+
+// electrical measurement and metering clusters on HA_ESP_ENDPOINT, fed by meter
+//   voltage in 0.1 V, current in mA, power in 0.1 W
+//   summation delivered in Wh and instantaneous demand in W, both over
+//   a divisor of 1000 so the coordinator shows kWh and kW
+void zb_meter_add_clusters(esp_zb_cluster_list_t *cluster_list);
+void zb_meter_update(const meter_reading_t *reading);
+
+#endif // ZB_METER_H
@@ -0,0 +1,313 @@
+#include "zb_report.h"
+#include "main.h"
+#include "temp_sensor.h"
+#include "string.h"
+#include "stdlib.h"
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+// the defaults until the coordinator configures reporting of an attribute
+#define REPORT_MIN_INTERVAL    CONFIG_BEER_REPORT_MIN_INTERVAL
+#define REPORT_MAX_INTERVAL    CONFIG_BEER_REPORT_MAX_INTERVAL
+#define REPORT_MIN_INTERVAL_US ((int64_t)REPORT_MIN_INTERVAL * 1000000)
+#define REPORT_MAX_INTERVAL_US ((int64_t)REPORT_MAX_INTERVAL * 1000000)
+#define REPORT_CHANGE          CONFIG_BEER_REPORT_CHANGE
+#define REPORT_DEADBAND        CONFIG_BEER_REPORT_DEADBAND
+#if CONFIG_BEER_REPORT_COMBINED
+#define REPORT_COMBINED        true
+#else
+#define REPORT_COMBINED        false
+#endif
+
+#define ZB_WARMER_ETA_UNKNOWN 0xFFFF
+
+#define CHANNEL_TEMP    0
+#define CHANNEL_HEATER  1
+#define CHANNEL_PROBE   2
+#define CHANNEL_COUNT   (CHANNEL_PROBE + EXAMPLE_ONEWIRE_MAX_DS18B20)
+
+static const char *TAG = "ZB_REPORT";
+
+// one reported attribute
+typedef struct {
+    uint8_t endpoint;
+    uint16_t cluster;
+    uint16_t attr;
+    int16_t value;      // attribute value, only follows changes beyond the deadband
+    int16_t reported;   // value in the last frame sent
+    int64_t last_us;    // time of the last frame, -1 before the first one
+    bool framed;        // in the status frame, else the stack reports it
+} report_channel_t;
+
+static report_channel_t channels[CHANNEL_COUNT];
+static int channel_count = 0;
+static zb_report_stats_t stats;
+
+// backing storage for the warmer cluster attributes
+static int16_t warmer_temp = TEMP_INVALID;
+static uint16_t warmer_duty = 0;
+static bool warmer_heater = false;
+static bool warmer_fault = false;
+static int16_t warmer_ambient = TEMP_INVALID;
+static uint16_t warmer_eta = ZB_WARMER_ETA_UNKNOWN;
+static uint16_t warmer_loss = 0;
+
+esp_zb_attribute_list_t *zb_report_warmer_cluster_create()
+{
+    esp_zb_attribute_list_t *cluster = esp_zb_zcl_attr_list_create(ZB_WARMER_CLUSTER_ID);
+    uint8_t access = ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING;
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_WARMER_ATTR_TEMPERATURE, ESP_ZB_ZCL_ATTR_TYPE_S16, access, &warmer_temp);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_WARMER_ATTR_HEATER_DUTY, ESP_ZB_ZCL_ATTR_TYPE_U16, access, &warmer_duty);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_WARMER_ATTR_HEATER_ON, ESP_ZB_ZCL_ATTR_TYPE_BOOL, access, &warmer_heater);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_WARMER_ATTR_AMBIENT, ESP_ZB_ZCL_ATTR_TYPE_S16, access, &warmer_ambient);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_WARMER_ATTR_ETA, ESP_ZB_ZCL_ATTR_TYPE_U16, access, &warmer_eta);
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_WARMER_ATTR_HEAT_LOSS, ESP_ZB_ZCL_ATTR_TYPE_U16, access, &warmer_loss);
+#if CONFIG_BEER_METER
+    esp_zb_custom_cluster_add_custom_attr(cluster, ZB_WARMER_ATTR_HEATER_FAULT, ESP_ZB_ZCL_ATTR_TYPE_BOOL, access, &warmer_fault);
+#endif
+    return cluster;
+}
+
+// the stack reports the attribute from the defaults until the coordinator
+// configures its own, so there is only ever one source of reports for it
+static void configure_reporting(const report_channel_t *ch)
+{
+    esp_zb_zcl_reporting_info_t info = {
+        .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_SRV,
+        .ep = ch->endpoint,
+        .cluster_id = ch->cluster,
+        .cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+        .dst.profile_id = ESP_ZB_AF_HA_PROFILE_ID,
+        .u.send_info.min_interval = REPORT_MIN_INTERVAL,
+        .u.send_info.max_interval = REPORT_MAX_INTERVAL,
+        .u.send_info.def_min_interval = REPORT_MIN_INTERVAL,
+        .u.send_info.def_max_interval = REPORT_MAX_INTERVAL,
+        .attr_id = ch->attr,
+        .manuf_code = ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC,
+    };
+    if (ch->cluster == ESP_ZB_ZCL_CLUSTER_ID_BINARY_INPUT) {
+        info.u.send_info.delta.u8 = 1;
+    } else {
+        info.u.send_info.delta.u16 = REPORT_CHANGE;
+    }
+    esp_zb_zcl_update_reporting_info(&info);
+}
+
+static void add_channel(uint8_t endpoint, uint16_t cluster, uint16_t attr, int16_t initial, bool framed)
+{
+    report_channel_t *ch = &channels[channel_count++];
+    *ch = (report_channel_t){
+        .endpoint = endpoint,
+        .cluster = cluster,
+        .attr = attr,
+        .value = initial,
+        .reported = initial,
+        .last_us = -1,
+        .framed = framed,
+    };
+    if (!framed) configure_reporting(ch);
+}
+
+// after esp_zb_device_register, the reporting configuration needs the endpoints
+void zb_report_init(int probe_count)
+{
+    channel_count = 0;
+    add_channel(HA_ESP_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT, ESP_ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID, TEMP_INVALID,
+                REPORT_COMBINED);
+    add_channel(HA_ESP_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_BINARY_INPUT, ESP_ZB_ZCL_ATTR_BINARY_INPUT_PRESENT_VALUE_ID, 0,
+                REPORT_COMBINED);
+    for (int i = 0; i < probe_count && i < EXAMPLE_ONEWIRE_MAX_DS18B20; i++) {
+        add_channel(HA_ESP_SENSOR_ENDPOINT_BASE + i, ESP_ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT, ESP_ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID,
+                    TEMP_INVALID, false);
+    }
+}
+
+// follow the new value only once it moves past the deadband, so neither reads
+// nor the stack's reporting see sensor noise. TEMP_INVALID, a lost sensor, is
+// taken straight away, it is the zcl invalid value as well
+static bool channel_set(report_channel_t *ch, int16_t value, int deadband)
+{
+    if (value == ch->value) return false;
+    if (value != TEMP_INVALID && ch->value != TEMP_INVALID && abs(value - ch->value) <= deadband) {
+        stats.suppressed++;
+        return false;
+    }
+    // a change still waiting for its status frame is replaced without one
+    if (ch->framed && ch->value != ch->reported) stats.suppressed++;
+    ch->value = value;
+
+    if (ch->cluster == ESP_ZB_ZCL_CLUSTER_ID_BINARY_INPUT) {
+        bool present = value;
+        esp_zb_zcl_set_attribute_val(ch->endpoint, ch->cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ch->attr, &present, false);
+    } else {
+        esp_zb_zcl_set_attribute_val(ch->endpoint, ch->cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ch->attr, &value, false);
+    }
+    return true;
+}
+
+#if CONFIG_BEER_REPORT_COMBINED
+// the status frame keeps to the default limits, the coordinator can't
+// configure reporting of a command
+static bool channel_due(const report_channel_t *ch, int change, int64_t now_us)
+{
+    // a lost sensor is news straight away, then nothing until it is back
+    if (ch->value == TEMP_INVALID) return ch->reported != TEMP_INVALID;
+    if (ch->last_us < 0) return true;
+    int64_t since = now_us - ch->last_us;
+    if (since >= REPORT_MAX_INTERVAL_US) return true;
+    if (since < REPORT_MIN_INTERVAL_US) return false;
+    return abs(ch->value - ch->reported) >= change;
+}
+#endif
+
+#if CONFIG_BEER_REPORT_COMBINED
+static void channel_sent(report_channel_t *ch, int64_t now_us)
+{
+    ch->reported = ch->value;
+    ch->last_us = now_us;
+}
+#endif
+
+static void send_report(const report_channel_t *ch)
+{
+    esp_zb_zcl_report_attr_cmd_t cmd = {
+        .zcl_basic_cmd = {
+            .src_endpoint = ch->endpoint,
+        },
+        .address_mode = ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+        .clusterID = ch->cluster,
+        .attributeID = ch->attr,
+        .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_CLI,
+    };
+    esp_zb_zcl_report_attr_cmd_req(&cmd);
+    stats.sent++;
+}
+
+#if CONFIG_BEER_REPORT_COMBINED
+// temperature and heater state as attribute reports in a single frame
+static void send_status()
+{
+    uint8_t payload[1 + 5 * 3 + 2 + 2 + 1 + 2 + 2];
+    int len = 1;
+
+    payload[len++] = ZB_WARMER_ATTR_TEMPERATURE & 0xFF;
+    payload[len++] = ZB_WARMER_ATTR_TEMPERATURE >> 8;
+    payload[len++] = ESP_ZB_ZCL_ATTR_TYPE_S16;
+    payload[len++] = (uint16_t)warmer_temp & 0xFF;
+    payload[len++] = (uint16_t)warmer_temp >> 8;
+    payload[len++] = ZB_WARMER_ATTR_HEATER_DUTY & 0xFF;
+    payload[len++] = ZB_WARMER_ATTR_HEATER_DUTY >> 8;
+    payload[len++] = ESP_ZB_ZCL_ATTR_TYPE_U16;
+    payload[len++] = warmer_duty & 0xFF;
+    payload[len++] = warmer_duty >> 8;
+    payload[len++] = ZB_WARMER_ATTR_HEATER_ON & 0xFF;
+    payload[len++] = ZB_WARMER_ATTR_HEATER_ON >> 8;
+    payload[len++] = ESP_ZB_ZCL_ATTR_TYPE_BOOL;
+    payload[len++] = warmer_heater;
+    payload[len++] = ZB_WARMER_ATTR_AMBIENT & 0xFF;
+    payload[len++] = ZB_WARMER_ATTR_AMBIENT >> 8;
+    payload[len++] = ESP_ZB_ZCL_ATTR_TYPE_S16;
+    payload[len++] = (uint16_t)warmer_ambient & 0xFF;
+    payload[len++] = (uint16_t)warmer_ambient >> 8;
+    payload[len++] = ZB_WARMER_ATTR_ETA & 0xFF;
+    payload[len++] = ZB_WARMER_ATTR_ETA >> 8;
+    payload[len++] = ESP_ZB_ZCL_ATTR_TYPE_U16;
+    payload[len++] = warmer_eta & 0xFF;
+    payload[len++] = warmer_eta >> 8;
+    payload[0] = len - 1;   // octet string length
+
+    esp_zb_zcl_custom_cluster_cmd_t cmd = {
+        .zcl_basic_cmd = {
+            .src_endpoint = HA_ESP_ENDPOINT,
+        },
+        .address_mode = ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+        .profile_id = ESP_ZB_AF_HA_PROFILE_ID,
+        .cluster_id = ZB_WARMER_CLUSTER_ID,
+        .custom_cmd_id = ZB_WARMER_CMD_STATUS,
+        .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_CLI,
+        .data = {
+            .type = ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING,
+            .size = len,
+            .value = payload,
+        },
+    };
+    esp_zb_zcl_custom_cluster_cmd_req(&cmd);
+    stats.sent++;
+}
+#endif
+
+// call once per sample, writes the changes past the deadband for the stack's
+// reporting and decides whether a status frame is due
+void zb_report_update(int16_t temp, uint16_t duty, const int16_t *probe_temps, int64_t now_us)
+{
+    report_channel_t *temp_ch = &channels[CHANNEL_TEMP];
+    report_channel_t *heater_ch = &channels[CHANNEL_HEATER];
+
+    if (!esp_zb_lock_acquire(portMAX_DELAY)) return;
+
+    channel_set(temp_ch, temp, REPORT_DEADBAND);
+    channel_set(heater_ch, duty > 0, 0);
+    for (int i = CHANNEL_PROBE; i < channel_count; i++) {
+        // a single failed read keeps the last value, a lost bus doesn't
+        int16_t probe = probe_temps[i - CHANNEL_PROBE];
+        if (probe != TEMP_INVALID || temp == TEMP_INVALID) channel_set(&channels[i], probe, REPORT_DEADBAND);
+    }
+
+    // the warmer cluster mirrors the deadbanded values
+    warmer_temp = temp_ch->value;
+    warmer_duty = duty;
+    warmer_heater = heater_ch->value;
+    esp_zb_zcl_set_attribute_val(HA_ESP_ENDPOINT, ZB_WARMER_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_WARMER_ATTR_TEMPERATURE, &warmer_temp, false);
+    esp_zb_zcl_set_attribute_val(HA_ESP_ENDPOINT, ZB_WARMER_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_WARMER_ATTR_HEATER_DUTY, &warmer_duty, false);
+    esp_zb_zcl_set_attribute_val(HA_ESP_ENDPOINT, ZB_WARMER_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_WARMER_ATTR_HEATER_ON, &warmer_heater, false);
+
+#if CONFIG_BEER_REPORT_COMBINED
+    // the standard attributes are left to the stack, the status frame is ours
+    if (channel_due(temp_ch, REPORT_CHANGE, now_us) || channel_due(heater_ch, 1, now_us)) {
+        send_status();
+        channel_sent(temp_ch, now_us);
+        channel_sent(heater_ch, now_us);
+    }
+#else
+    (void)now_us;
+#endif
+    esp_zb_lock_release();
+    ESP_LOGD(TAG, "%lu frames sent, %lu suppressed", (unsigned long)stats.sent, (unsigned long)stats.suppressed);
+}
+
+// sent straight away, outside of the rate limiting
+void zb_report_heater_fault(bool fault)
+{
+    report_channel_t ch = {
+        .endpoint = HA_ESP_ENDPOINT,
+        .cluster = ZB_WARMER_CLUSTER_ID,
+        .attr = ZB_WARMER_ATTR_HEATER_FAULT,
+    };
+    if (!esp_zb_lock_acquire(portMAX_DELAY)) return;
+    warmer_fault = fault;
+    esp_zb_zcl_set_attribute_val(HA_ESP_ENDPOINT, ZB_WARMER_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_WARMER_ATTR_HEATER_FAULT, &warmer_fault, false);
+    send_report(&ch);
+    esp_zb_lock_release();
+}
+
+// readable attributes, they go out with the next status frame
+void zb_report_forecast(int16_t ambient, int32_t eta_s, uint16_t heat_loss)
+{
+    uint16_t eta = eta_s < 0 || (eta_s + 59) / 60 >= ZB_WARMER_ETA_UNKNOWN ? ZB_WARMER_ETA_UNKNOWN : (eta_s + 59) / 60;
+    if (ambient == warmer_ambient && eta == warmer_eta && heat_loss == warmer_loss) return;
+
+    if (!esp_zb_lock_acquire(portMAX_DELAY)) return;
+    warmer_ambient = ambient;
+    warmer_eta = eta;
+    warmer_loss = heat_loss;
+    esp_zb_zcl_set_attribute_val(HA_ESP_ENDPOINT, ZB_WARMER_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_WARMER_ATTR_AMBIENT, &warmer_ambient, false);
+    esp_zb_zcl_set_attribute_val(HA_ESP_ENDPOINT, ZB_WARMER_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_WARMER_ATTR_ETA, &warmer_eta, false);
+    esp_zb_zcl_set_attribute_val(HA_ESP_ENDPOINT, ZB_WARMER_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_WARMER_ATTR_HEAT_LOSS, &warmer_loss, false);
+    esp_zb_lock_release();
+}
+
+void zb_report_get_stats(zb_report_stats_t *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,35 @@
+#ifndef ZB_REPORT_H
+#define ZB_REPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_zigbee_core.h"
+
+// manufacturer specific cluster on HA_ESP_ENDPOINT with the warmer's state
+#define ZB_WARMER_CLUSTER_ID        0xFC00
+#define ZB_WARMER_ATTR_TEMPERATURE  0x0000  // int16, centi-degrees
+#define ZB_WARMER_ATTR_HEATER_DUTY  0x0001  // uint16, per mille
+#define ZB_WARMER_ATTR_HEATER_ON    0x0002  // bool
+#define ZB_WARMER_ATTR_HEATER_FAULT 0x0003  // bool, element open, only with the power meter
+#define ZB_WARMER_ATTR_AMBIENT      0x0004  // int16, centi-degrees, invalid without an ambient probe
+#define ZB_WARMER_ATTR_ETA          0x0005  // uint16, minutes to the target, 0xffff unknown
+#define ZB_WARMER_ATTR_HEAT_LOSS    0x0006  // uint16, per mille of the difference to ambient per hour
+// server to client through the bindings of the cluster, only with
+// BEER_REPORT_COMBINED. payload is a list of zcl attribute reports
+// (id, type, value) carrying temperature, duty, heater state, ambient
+// and eta in one frame
+#define ZB_WARMER_CMD_STATUS        0x00
+
+typedef struct {
+    uint32_t sent;          // status and fault frames, the stack's own attribute reports aren't seen
+    uint32_t suppressed;    // changes dropped by the deadband or replaced before their status frame
+} zb_report_stats_t;
+
+esp_zb_attribute_list_t *zb_report_warmer_cluster_create();
+void zb_report_init(int probe_count);
+void zb_report_update(int16_t temp, uint16_t duty, const int16_t *probe_temps, int64_t now_us);
+void zb_report_heater_fault(bool fault);
+void zb_report_forecast(int16_t ambient, int32_t eta_s, uint16_t heat_loss);
+void zb_report_get_stats(zb_report_stats_t *stats);
+
+#endif // ZB_REPORT_H
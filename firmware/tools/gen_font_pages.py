@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+"""Transpose font8x8_basic.h into the SSD1306 page layout.
+
+The source font stores each glyph as 8 rows with bit x set for column x.
+The display buffer stores one byte per column with bit y set for row y, so
+the glyph is transposed here once instead of bit by bit at draw time.
+
+usage: gen_font_pages.py main/font8x8_basic.h main/font8x8_basic_pages.h
+"""
+import re
+import sys
+
+
+def main():
+    src, dst = sys.argv[1], sys.argv[2]
+    glyphs = []
+    comments = []
+    with open(src) as f:
+        for line in f:
+            m = re.match(r'\s*\{([^}]*)\}\s*,?\s*(//.*)?$', line)
+            if not m:
+                continue
+            glyphs.append([int(v, 16) for v in m.group(1).split(',')])
+            comments.append(m.group(2) or '')
+    assert len(glyphs) == 128, 'expected 128 glyphs, got %d' % len(glyphs)
+
+    with open(dst, 'w') as f:
+        f.write('// Generated by tools/gen_font_pages.py from font8x8_basic.h, do not edit.\n')
+        f.write('// Same glyphs as font8x8_basic, one byte per column, bit 0 is the top row.\n\n')
+        f.write('#ifndef FONT8X8_BASIC_PAGES_H\n#define FONT8X8_BASIC_PAGES_H\n\n')
+        f.write('#include <stdint.h>\n\n')
+        f.write('static const uint8_t font8x8_basic_pages[128][8] = {\n')
+        for i, (rows, comment) in enumerate(zip(glyphs, comments)):
+            cols = [sum(((rows[y] >> x) & 1) << y for y in range(8)) for x in range(8)]
+            sep = ',' if i < 127 else ' '
+            f.write('    { %s}%s   %s\n' % (', '.join('0x%02X' % c for c in cols), sep, comment))
+        f.write('};\n\n#endif // FONT8X8_BASIC_PAGES_H\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""List the static RAM of every firmware module from the linker map.
+
+Everything the application allocates lives in .data and .bss, tasks and
+their stacks included, so the map shows the whole budget without running
+the firmware. Sections are attributed to the object file that defined
+them: one line per source file of main, one per library for the rest.
+Heap use at runtime is reported by the "prof" console command and the
+diagnostics cluster instead.
+
+usage:
+  idf.py ram_report                                   after a build, with the 20 largest symbols
+  ram_report.py build/on_off_light_bulb.map [-s N]   also list the N largest symbols of main
+"""
+import argparse
+import collections
+import re
+import sys
+
+# output sections that end up in internal RAM, code in IRAM included
+RAM_SECTIONS = {
+    '.iram0.text': 'iram',
+    '.iram0.data': 'iram',
+    '.iram0.bss': 'iram',
+    '.dram0.data': 'data',
+    '.dram0.bss': 'bss',
+    '.noinit': 'bss',
+}
+KINDS = ('iram', 'data', 'bss')
+
+OUTPUT_RE = re.compile(r'^(\.\S+)')
+INPUT_RE = re.compile(r'^ (\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+)$')
+NAME_ONLY_RE = re.compile(r'^ (\.\S+|COMMON)$')
+OBJECT_RE = re.compile(r'(?:.*/)?(lib[^/(]+)\.a\(([^)]+)\)$')
+
+
+def module(path):
+    m = OBJECT_RE.match(path)
+    if not m:
+        return path.rsplit('/', 1)[-1]
+    lib, obj = m.groups()
+    if lib == 'libmain':
+        return obj.replace('.c.obj', '').replace('.obj', '')
+    return lib
+
+
+def parse(path):
+    sizes = collections.defaultdict(lambda: dict.fromkeys(KINDS, 0))
+    symbols = []
+    kind = None
+    pending = None
+    in_map = False
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip('\n')
+            if not in_map:
+                in_map = line.startswith('Linker script and memory map')
+                continue
+
+            m = OUTPUT_RE.match(line)
+            if m:
+                kind = RAM_SECTIONS.get(m.group(1))
+                pending = None
+                continue
+            if kind is None:
+                continue
+
+            # long input section names put the address on the next line
+            m = NAME_ONLY_RE.match(line)
+            if m:
+                pending = m.group(1)
+                continue
+            m = INPUT_RE.match(line)
+            if not m:
+                continue
+            name = m.group(1) or pending
+            pending = None
+            size = int(m.group(3), 16)
+            if not name or name == '*fill*' or size == 0:
+                continue
+
+            mod = module(m.group(4))
+            sizes[mod][kind] += size
+            if 'libmain.a' in m.group(4):
+                symbols.append((size, mod, name))
+    if not in_map:
+        sys.exit('%s: no memory map found' % path)
+    return sizes, symbols
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('map', help='linker map file')
+    parser.add_argument('-s', '--symbols', type=int, default=0, metavar='N',
+                        help='also list the N largest symbols of main')
+    args = parser.parse_args()
+
+    sizes, symbols = parse(args.map)
+    rows = sorted(sizes.items(), key=lambda item: -sum(item[1].values()))
+
+    print('%-28s %8s %8s %8s %8s' % ('module', 'iram', 'data', 'bss', 'total'))
+    totals = dict.fromkeys(KINDS, 0)
+    for mod, s in rows:
+        print('%-28s %8d %8d %8d %8d' % (mod, s['iram'], s['data'], s['bss'], sum(s.values())))
+        for k in KINDS:
+            totals[k] += s[k]
+    print('%-28s %8d %8d %8d %8d' % ('total', totals['iram'], totals['data'], totals['bss'],
+                                     sum(totals.values())))
+
+    if args.symbols:
+        print('\n%-28s %-16s %8s' % ('section', 'module', 'bytes'))
+        for size, mod, name in sorted(symbols, reverse=True)[:args.symbols]:
+            print('%-28s %-16s %8d' % (name, mod, size))
+
+
+if __name__ == '__main__':
+    main()
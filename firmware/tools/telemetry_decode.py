@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""Decode a dump of the telemetry partition into CSV.
+
+The partition is a ring of 256 byte blocks written by main/telemetry.c. Each
+block has a header with the first sample and a CRC, followed by the other
+samples as varint(dt) varint(zigzag(dtemp) << 1 | heater). Blocks that are
+erased or fail the CRC are skipped, the rest are sorted by sequence number.
+
+usage:
+  parttool.py read_partition --partition-name telemetry --output telemetry.bin
+  telemetry_decode.py telemetry.bin > telemetry.csv
+"""
+import struct
+import sys
+import zlib
+
+BLOCK_SIZE = 256
+MAGIC = 0x4254
+VERSION = 1
+HEADER = struct.Struct('<HBBIIIHhBBI')
+CRC_OFFSET = HEADER.size - 4
+
+
+def varint(data, pos):
+    value = shift = 0
+    while True:
+        b = data[pos]
+        value |= (b & 0x7F) << shift
+        pos += 1
+        if not b & 0x80:
+            return value, pos
+        shift += 7
+
+
+def decode_block(block):
+    (magic, version, count, seq, first_sample, time_s, boot, temp, heater,
+     payload_len, crc) = HEADER.unpack_from(block)
+    if magic != MAGIC or version != VERSION or count == 0:
+        return None
+    if payload_len > BLOCK_SIZE - HEADER.size:
+        return None
+    payload = block[HEADER.size:HEADER.size + payload_len]
+    if zlib.crc32(payload, zlib.crc32(block[:CRC_OFFSET])) != crc:
+        return None
+
+    records = [(first_sample, boot, time_s, temp, heater)]
+    pos = 0
+    for n in range(1, count):
+        dt, pos = varint(payload, pos)
+        value, pos = varint(payload, pos)
+        zigzag = value >> 1
+        time_s += dt
+        temp += (zigzag >> 1) ^ -(zigzag & 1)
+        records.append((first_sample + n, boot, time_s, temp, value & 1))
+    return seq, records
+
+
+def main():
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+
+    blocks = []
+    bad = 0
+    for offset in range(0, len(data) - BLOCK_SIZE + 1, BLOCK_SIZE):
+        block = data[offset:offset + BLOCK_SIZE]
+        if block == b'\xff' * BLOCK_SIZE:
+            continue
+        decoded = decode_block(block)
+        if decoded is None:
+            bad += 1
+            continue
+        blocks.append(decoded)
+    blocks.sort()
+
+    print('seq,boot,time_s,temp_c,heater')
+    for _, records in blocks:
+        for seq, boot, time_s, temp, heater in records:
+            print('%d,%d,%d,%.2f,%d' % (seq, boot, time_s, temp / 100, heater))
+    print('%d blocks, %d corrupt' % (len(blocks), bad), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()